@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPARE_SSE2 1
+#endif
+
+#include "compare.h"
+
+static constexpr float kr{ 0.2126f };
+static constexpr float kg{ 0.7152f };
+static constexpr float kb{ 0.0722f };
+
+// acc[x] += luma(src0) - luma(src1) for one row
+static void accumulateRow(float* acc, const float* const src0[3], const float* const src1[3], const ptrdiff_t offset, const int width) noexcept {
+    auto r0{ src0[0] + offset };
+    auto g0{ src0[1] + offset };
+    auto b0{ src0[2] + offset };
+    auto r1{ src1[0] + offset };
+    auto g1{ src1[1] + offset };
+    auto b1{ src1[2] + offset };
+
+    auto x{ 0 };
+
+#ifdef COMPARE_SSE2
+    const auto vkr{ _mm_set1_ps(kr) };
+    const auto vkg{ _mm_set1_ps(kg) };
+    const auto vkb{ _mm_set1_ps(kb) };
+
+    for (; x + 4 <= width; x += 4) {
+        auto diff{ _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(r0 + x), _mm_loadu_ps(r1 + x)), vkr) };
+        diff = _mm_add_ps(diff, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(g0 + x), _mm_loadu_ps(g1 + x)), vkg));
+        diff = _mm_add_ps(diff, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b0 + x), _mm_loadu_ps(b1 + x)), vkb));
+        _mm_storeu_ps(acc + x, _mm_add_ps(_mm_loadu_ps(acc + x), diff));
+    }
+#endif
+
+    for (; x < width; x++)
+        acc[x] += (r0[x] - r1[x]) * kr + (g0[x] - g1[x]) * kg + (b0[x] - b1[x]) * kb;
+}
+
+double framePSNR(const float* const src0[3], const float* const src1[3], const int width, const int height, const ptrdiff_t stride) noexcept {
+    // the luma difference is linear, so the difference of the downscaled frames is the downscaled difference
+    const auto factorX{ (width + 511) / 512 };
+    const auto factorY{ (height + 511) / 512 };
+    const auto outWidth{ width / factorX };
+    const auto outHeight{ height / factorY };
+    const auto norm{ 1.0 / (factorX * factorY) };
+
+    std::vector<float> acc(width);
+    auto sse{ 0.0 };
+
+    for (auto y{ 0 }; y < outHeight; y++) {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+
+        for (auto i{ 0 }; i < factorY; i++)
+            accumulateRow(acc.data(), src0, src1, stride * (y * factorY + i), width);
+
+        for (auto x{ 0 }; x < outWidth; x++) {
+            auto sum{ 0.0 };
+            for (auto i{ 0 }; i < factorX; i++)
+                sum += acc[x * factorX + i];
+
+            const auto diff{ sum * norm };
+            sse += diff * diff;
+        }
+    }
+
+    const auto mse{ sse / (static_cast<double>(outWidth) * outHeight) };
+    return mse > 0.0 ? std::min(10.0 * std::log10(1.0 / mse), 60.0) : 60.0;
+}
+
+static constexpr uint64_t hashKey0{ 0xbe4ba423396cfeb8ULL };
+static constexpr uint64_t hashKey1{ 0x1cad21f72c81017cULL };
+
+static uint64_t mix(uint64_t h) noexcept {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// the hash is stored in disk_cache entries, so both paths give the same value and every build shares them
+uint64_t frameHash(const float* const src[3], const int width, const int height, const ptrdiff_t stride) noexcept {
+    const auto rowSize{ static_cast<size_t>(width) * sizeof(float) };
+    uint64_t lanes[2]{ hashKey0, hashKey1 };
+    uint64_t tail{ 0 };
+    uint64_t index{ 0 };
+
+    // XXH3-style accumulation of 16 byte blocks, with the key offset by the block index so that the sum depends on block order
+#ifdef COMPARE_SSE2
+    auto acc{ _mm_set_epi64x(static_cast<int64_t>(hashKey1), static_cast<int64_t>(hashKey0)) };
+    const auto key{ _mm_set_epi64x(static_cast<int64_t>(hashKey0), static_cast<int64_t>(hashKey1)) };
+    const auto step{ _mm_set1_epi64x(1) };
+    auto counter{ _mm_setzero_si128() };
+#else
+    uint64_t acc[2]{ hashKey0, hashKey1 };
+    const uint64_t key[2]{ hashKey1, hashKey0 };
+    uint64_t counter{ 0 };
+#endif
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        for (auto y{ 0 }; y < height; y++) {
+            auto row{ reinterpret_cast<const unsigned char*>(src[plane] + stride * y) };
+            size_t i{ 0 };
+
+#ifdef COMPARE_SSE2
+            for (; i + 16 <= rowSize; i += 16) {
+                const auto data{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) };
+                const auto dataKey{ _mm_xor_si128(data, _mm_add_epi64(key, counter)) };
+                const auto product{ _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1))) };
+                acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)), product));
+                counter = _mm_add_epi64(counter, step);
+            }
+#else
+            for (; i + 16 <= rowSize; i += 16) {
+                uint64_t data[2];
+                memcpy(data, row + i, 16);
+                for (auto lane{ 0 }; lane < 2; lane++) {
+                    const auto dataKey{ data[lane] ^ (key[lane] + counter) };
+                    acc[lane] += data[lane ^ 1] + (dataKey & 0xffffffffULL) * (dataKey >> 32);
+                }
+                counter++;
+            }
+#endif
+
+            for (; i + 8 <= rowSize; i += 8) {
+                uint64_t word;
+                memcpy(&word, row + i, 8);
+                lanes[index & 1] = (lanes[index & 1] ^ word) * 0x9e3779b97f4a7c15ULL;
+                index++;
+            }
+
+            for (; i < rowSize; i++)
+                tail = (tail ^ row[i]) * 0x100000001b3ULL;
+        }
+    }
+
+#ifdef COMPARE_SSE2
+    uint64_t accLanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(accLanes), acc);
+    lanes[0] ^= accLanes[0];
+    lanes[1] ^= accLanes[1];
+#else
+    lanes[0] ^= acc[0];
+    lanes[1] ^= acc[1];
+#endif
+
+    return mix(lanes[0] ^ mix(lanes[1] + tail) ^ (static_cast<uint64_t>(width) << 32 | static_cast<uint32_t>(height)));
+}
+
+float sampledMaxDiff(const float* const src0[3], const float* const src1[3], const int width, const int height, const ptrdiff_t stride) noexcept {
+    auto maxDiff{ 0.0f };
+
+#ifdef COMPARE_SSE2
+    const auto absMask{ _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)) };
+    auto vmax{ _mm_setzero_ps() };
+#endif
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        for (auto y{ 0 }; y < height; y += 4) {
+            auto p0{ src0[plane] + stride * y };
+            auto p1{ src1[plane] + stride * y };
+            auto x{ 0 };
+
+#ifdef COMPARE_SSE2
+            for (; x + 4 <= width; x += 4)
+                vmax = _mm_max_ps(vmax, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(p0 + x), _mm_loadu_ps(p1 + x)), absMask));
+#endif
+
+            for (; x < width; x++)
+                maxDiff = std::max(maxDiff, std::abs(p0[x] - p1[x]));
+        }
+    }
+
+#ifdef COMPARE_SSE2
+    float lanes[4];
+    _mm_storeu_ps(lanes, vmax);
+    maxDiff = std::max({ maxDiff, lanes[0], lanes[1], lanes[2], lanes[3] });
+#endif
+
+    return maxDiff;
+}
+
+float sceneChangeBlocks(const float* const src0[3], const float* const src1[3], const int width, const int height, const ptrdiff_t stride,
+                        const float threshold) noexcept {
+    const auto gridWidth{ std::min(width, 16) };
+    const auto gridHeight{ std::min(height, 16) };
+    auto changed{ 0 };
+
+    for (auto gy{ 0 }; gy < gridHeight; gy++) {
+        for (auto gx{ 0 }; gx < gridWidth; gx++) {
+            const auto x0{ gx * width / gridWidth };
+            const auto x1{ (gx + 1) * width / gridWidth };
+            const auto y0{ gy * height / gridHeight };
+            const auto y1{ (gy + 1) * height / gridHeight };
+            float sum0[3]{};
+            float sum1[3]{};
+            auto count{ 0 };
+
+            for (auto y{ y0 }; y < y1; y += 4) {
+                for (auto x{ x0 }; x < x1; x += 4) {
+                    for (auto plane{ 0 }; plane < 3; plane++) {
+                        sum0[plane] += src0[plane][stride * y + x];
+                        sum1[plane] += src1[plane][stride * y + x];
+                    }
+                    count++;
+                }
+            }
+
+            if (count > 0 && (std::abs(sum0[0] - sum1[0]) + std::abs(sum0[1] - sum1[1]) + std::abs(sum0[2] - sum1[2])) / (3 * count) > threshold)
+                changed++;
+        }
+    }
+
+    return static_cast<float>(changed) / (gridWidth * gridHeight);
+}
+
+static constexpr int dirtyBlockSize{ 32 };
+
+static Rect unite(const Rect& a, const Rect& b) noexcept {
+    const auto x{ std::min(a.x, b.x) };
+    const auto y{ std::min(a.y, b.y) };
+    return { x, y, std::max(a.x + a.width, b.x + b.width) - x, std::max(a.y + a.height, b.y + b.height) - y };
+}
+
+static bool overlaps(const Rect& a, const Rect& b) noexcept {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static Rect expand(const Rect& r, const int margin, const int width, const int height) noexcept {
+    const auto x{ std::max(r.x - margin, 0) };
+    const auto y{ std::max(r.y - margin, 0) };
+    return { x, y, std::min(r.x + r.width + margin, width) - x, std::min(r.y + r.height + margin, height) - y };
+}
+
+std::vector<DirtyRegion> dirtyRegions(const float* const src0[3], const float* const src1[3], const int width, const int height, const ptrdiff_t stride,
+                                      const float threshold, const int margin) {
+    const auto gridWidth{ (width + dirtyBlockSize - 1) / dirtyBlockSize };
+    const auto gridHeight{ (height + dirtyBlockSize - 1) / dirtyBlockSize };
+
+    // per block maximum absolute difference, a row of blocks at a time
+    std::vector<float> blockDiff(static_cast<size_t>(gridWidth) * gridHeight);
+
+#ifdef COMPARE_SSE2
+    const auto absMask{ _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)) };
+#endif
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        for (auto y{ 0 }; y < height; y++) {
+            auto p0{ src0[plane] + stride * y };
+            auto p1{ src1[plane] + stride * y };
+            auto diffRow{ blockDiff.data() + static_cast<size_t>(y / dirtyBlockSize) * gridWidth };
+
+            for (auto bx{ 0 }; bx < gridWidth; bx++) {
+                const auto start{ bx * dirtyBlockSize };
+                const auto end{ std::min(start + dirtyBlockSize, width) };
+                auto maxDiff{ diffRow[bx] };
+                auto x{ start };
+
+#ifdef COMPARE_SSE2
+                auto vmax{ _mm_setzero_ps() };
+                for (; x + 4 <= end; x += 4)
+                    vmax = _mm_max_ps(vmax, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(p0 + x), _mm_loadu_ps(p1 + x)), absMask));
+
+                float lanes[4];
+                _mm_storeu_ps(lanes, vmax);
+                maxDiff = std::max({ maxDiff, lanes[0], lanes[1], lanes[2], lanes[3] });
+#endif
+
+                for (; x < end; x++)
+                    maxDiff = std::max(maxDiff, std::abs(p0[x] - p1[x]));
+
+                diffRow[bx] = maxDiff;
+            }
+        }
+    }
+
+    // group dirty blocks that are within margin of each other
+    const auto reach{ (margin + dirtyBlockSize - 1) / dirtyBlockSize };
+    std::vector<int> label(blockDiff.size(), -1);
+    std::vector<int> stack;
+    std::vector<DirtyRegion> regions;
+
+    for (auto start{ 0 }; start < static_cast<int>(blockDiff.size()); start++) {
+        if (blockDiff[start] <= threshold || label[start] != -1)
+            continue;
+
+        const auto id{ static_cast<int>(regions.size()) };
+        label[start] = id;
+        stack.push_back(start);
+
+        Rect inner{ (start % gridWidth) * dirtyBlockSize, (start / gridWidth) * dirtyBlockSize, 0, 0 };
+        inner.width = std::min(dirtyBlockSize, width - inner.x);
+        inner.height = std::min(dirtyBlockSize, height - inner.y);
+
+        while (!stack.empty()) {
+            const auto block{ stack.back() };
+            stack.pop_back();
+
+            const auto bx{ block % gridWidth };
+            const auto by{ block / gridWidth };
+            const auto x{ bx * dirtyBlockSize };
+            const auto y{ by * dirtyBlockSize };
+            inner = unite(inner, { x, y, std::min(dirtyBlockSize, width - x), std::min(dirtyBlockSize, height - y) });
+
+            for (auto ny{ std::max(by - reach, 0) }; ny <= std::min(by + reach, gridHeight - 1); ny++) {
+                for (auto nx{ std::max(bx - reach, 0) }; nx <= std::min(bx + reach, gridWidth - 1); nx++) {
+                    const auto neighbor{ ny * gridWidth + nx };
+                    if (blockDiff[neighbor] > threshold && label[neighbor] == -1) {
+                        label[neighbor] = id;
+                        stack.push_back(neighbor);
+                    }
+                }
+            }
+        }
+
+        regions.push_back({ inner, expand(inner, margin, width, height) });
+    }
+
+    // merging can make a region overlap one that was already checked, so repeat until nothing changes
+    for (auto merged{ true }; merged;) {
+        merged = false;
+
+        for (size_t i{ 0 }; i < regions.size(); i++) {
+            for (auto j{ i + 1 }; j < regions.size();) {
+                if (overlaps(regions[i].outer, regions[j].outer)) {
+                    regions[i].inner = unite(regions[i].inner, regions[j].inner);
+                    regions[i].outer = expand(regions[i].inner, margin, width, height);
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                } else {
+                    j++;
+                }
+            }
+        }
+    }
+
+    return regions;
+}
+
+static bool darkRow(const float* const src[3], const ptrdiff_t offset, const int width, const float threshold) noexcept {
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        auto p{ src[plane] + offset };
+        auto x{ 0 };
+
+#ifdef COMPARE_SSE2
+        const auto vthreshold{ _mm_set1_ps(threshold) };
+        for (; x + 4 <= width; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(p + x), vthreshold)))
+                return false;
+        }
+#endif
+
+        for (; x < width; x++) {
+            if (p[x] > threshold)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool darkPixel(const float* const src[3], const ptrdiff_t offset, const float threshold) noexcept {
+    return src[0][offset] <= threshold && src[1][offset] <= threshold && src[2][offset] <= threshold;
+}
+
+Rect activeArea(const float* const src[3], const int width, const int height, const ptrdiff_t stride, const float threshold) noexcept {
+    auto top{ 0 };
+    while (top < height && darkRow(src, stride * top, width, threshold))
+        top++;
+
+    // entirely black
+    if (top == height)
+        return { 0, 0, 0, 0 };
+
+    auto bottom{ height };
+    while (bottom > top && darkRow(src, stride * (bottom - 1), width, threshold))
+        bottom--;
+
+    auto left{ width };
+    auto right{ 0 };
+    for (auto y{ top }; y < bottom; y += 4) {
+        const auto offset{ stride * y };
+
+        auto x{ 0 };
+        while (x < left && darkPixel(src, offset + x, threshold))
+            x++;
+        left = x;
+
+        x = width;
+        while (x > right && darkPixel(src, offset + x - 1, threshold))
+            x--;
+        right = x;
+    }
+
+    if (right <= left)
+        return { 0, top, width, bottom - top };
+
+    return { left, top, right - left, bottom - top };
+}
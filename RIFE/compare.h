@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Rect final {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// a changed part of the frame: inner covers the changed blocks and is what gets written back,
+// outer adds the context margin and is what the networks run on
+struct DirtyRegion final {
+    Rect inner;
+    Rect outer;
+};
+
+// PSNR of the BT.709 luma of two planar RGB float frames, measured on a box-downscaled copy no larger than 512x512
+// and capped at 60 dB, the same range as the psnr_y of 8-bit video
+double framePSNR(const float* const src0[3], const float* const src1[3], int width, int height, ptrdiff_t stride) noexcept;
+
+// 64-bit hash of the pixels of a planar RGB float frame, padding excluded
+uint64_t frameHash(const float* const src[3], int width, int height, ptrdiff_t stride) noexcept;
+
+// maximum absolute difference of two planar RGB float frames over every 4th row
+float sampledMaxDiff(const float* const src0[3], const float* const src1[3], int width, int height, ptrdiff_t stride) noexcept;
+
+// fraction of the blocks of a 16x16 grid whose mean colors differ by more than threshold, each sampled on every 4th pixel
+// in both directions, the same measure as the sc_gpu test of RIFE, which sees a scene change above half
+float sceneChangeBlocks(const float* const src0[3], const float* const src1[3], int width, int height, ptrdiff_t stride,
+                        float threshold) noexcept;
+
+// regions of the frame where some 32x32 block has a maximum absolute difference above threshold
+// blocks closer than margin share a region, and regions whose outer rects overlap are merged
+std::vector<DirtyRegion> dirtyRegions(const float* const src0[3], const float* const src1[3], int width, int height, ptrdiff_t stride,
+                                      float threshold, int margin);
+
+// the part of a planar RGB float frame inside its constant black borders, where every value is at most threshold
+// rows are checked in full, columns on every 4th row
+Rect activeArea(const float* const src[3], int width, int height, ptrdiff_t stride, float threshold) noexcept;
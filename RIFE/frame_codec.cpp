@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "frame_codec.h"
+
+static constexpr unsigned char magic[4]{ 'R', 'I', 'F', 'C' };
+static constexpr uint32_t version{ 1 };
+static constexpr size_t headerSize{ 16 };
+
+// bytes kept of a residual for each 2-bit code, a value needs the smallest code that holds it
+static constexpr int codeBytes[4]{ 0, 2, 3, 4 };
+
+static uint32_t floatBits(const float v) noexcept {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(const uint32_t bits) noexcept {
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// the median edge detector of LOCO-I, only min, max, + and - so that the decoder predicts bit for bit the same
+static float predict(const float* row, const float* above, const int x, const int y) noexcept {
+    if (y == 0)
+        return x > 0 ? row[x - 1] : 0.0f;
+    if (x == 0)
+        return above[0];
+
+    const auto a{ row[x - 1] };
+    const auto b{ above[x] };
+    const auto c{ above[x - 1] };
+
+    if (c >= std::max(a, b))
+        return std::min(a, b);
+    if (c <= std::min(a, b))
+        return std::max(a, b);
+    return a + b - c;
+}
+
+static int residualCode(const uint32_t residual) noexcept {
+    if (residual == 0)
+        return 0;
+    if (residual < 0x10000)
+        return 1;
+    if (residual < 0x1000000)
+        return 2;
+    return 3;
+}
+
+static void putU32(unsigned char* p, const uint32_t v) noexcept {
+    for (auto i{ 0 }; i < 4; i++)
+        p[i] = static_cast<unsigned char>(v >> (i * 8));
+}
+
+static uint32_t getU32(const unsigned char* p) noexcept {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+std::vector<unsigned char> compressFrame(const float* const src[3], const int width, const int height, const ptrdiff_t stride) {
+    const auto count{ static_cast<size_t>(width) * height * 3 };
+
+    // the worst case is every value stored in full, plus a code byte for every 4 values
+    std::vector<unsigned char> out(headerSize + count * 4 + (count + 3) / 4);
+    std::memcpy(out.data(), magic, 4);
+    putU32(out.data() + 4, version);
+    putU32(out.data() + 8, static_cast<uint32_t>(width));
+    putU32(out.data() + 12, static_cast<uint32_t>(height));
+
+    auto p{ out.data() + headerSize };
+    unsigned char* codes{};
+    size_t n{ 0 };
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        for (auto y{ 0 }; y < height; y++) {
+            auto row{ src[plane] + stride * y };
+            auto above{ row - stride };
+
+            for (auto x{ 0 }; x < width; x++, n++) {
+                // zigzag, so that small negative differences have few bytes too
+                const auto diff{ floatBits(row[x]) - floatBits(predict(row, above, x, y)) };
+                const auto residual{ diff << 1 ^ (0 - (diff >> 31)) };
+                const auto code{ residualCode(residual) };
+
+                if (n % 4 == 0) {
+                    codes = p++;
+                    *codes = 0;
+                }
+                *codes |= static_cast<unsigned char>(code << (n % 4 * 2));
+
+                for (auto i{ 0 }; i < codeBytes[code]; i++)
+                    *p++ = static_cast<unsigned char>(residual >> (i * 8));
+            }
+        }
+    }
+
+    out.resize(p - out.data());
+    return out;
+}
+
+bool decompressFrame(const unsigned char* data, const size_t size, float* const dst[3], const int width, const int height,
+                     const ptrdiff_t stride) noexcept {
+    if (size < headerSize || std::memcmp(data, magic, 4) != 0 || getU32(data + 4) != version ||
+        getU32(data + 8) != static_cast<uint32_t>(width) || getU32(data + 12) != static_cast<uint32_t>(height))
+        return false;
+
+    auto p{ data + headerSize };
+    const auto end{ data + size };
+    unsigned char codes{};
+    size_t n{ 0 };
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        for (auto y{ 0 }; y < height; y++) {
+            auto row{ dst[plane] + stride * y };
+            auto above{ row - stride };
+
+            for (auto x{ 0 }; x < width; x++, n++) {
+                if (n % 4 == 0) {
+                    if (p == end)
+                        return false;
+                    codes = *p++;
+                }
+
+                const auto code{ codes >> (n % 4 * 2) & 3 };
+                if (end - p < codeBytes[code])
+                    return false;
+
+                uint32_t residual{ 0 };
+                for (auto i{ 0 }; i < codeBytes[code]; i++)
+                    residual |= static_cast<uint32_t>(*p++) << (i * 8);
+
+                const auto diff{ residual >> 1 ^ (0 - (residual & 1)) };
+                row[x] = bitsFloat(floatBits(predict(row, above, x, y)) + diff);
+            }
+        }
+    }
+
+    return p == end;
+}
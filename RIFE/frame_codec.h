@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// lossless compression of a planar RGB float frame, each value is predicted from its left, upper and upper-left
+// neighbours and only the bytes of the difference to the prediction are stored, padding excluded
+std::vector<unsigned char> compressFrame(const float* const src[3], int width, int height, ptrdiff_t stride);
+
+// false if data is not a frame of width x height written by compressFrame
+bool decompressFrame(const unsigned char* data, size_t size, float* const dst[3], int width, int height, ptrdiff_t stride) noexcept;
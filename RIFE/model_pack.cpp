@@ -0,0 +1,309 @@
+// rife implemented with ncnn library
+
+#include "model_pack.h"
+
+#include <string.h>
+
+// ncnn
+#include "datareader.h"
+#include "platform.h"
+
+static const char model_pack_magic[8] = { 'R', 'I', 'F', 'E', 'P', 'A', 'C', 'K' };
+
+struct ModelPackHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t entry_count;
+    uint32_t reserved;
+    char ncnn_version[32];
+};
+
+struct ModelPackEntryHeader
+{
+    char name[16];
+    uint32_t flags;
+    uint32_t elempack;
+    uint64_t param_offset;
+    uint64_t param_size;
+    uint64_t model_offset;
+    uint64_t model_size;
+};
+
+// forwards every read to another reader and keeps a copy of what was read
+// reference() is not forwarded so that ncnn always takes the read path
+class DataReaderRecorder : public ncnn::DataReader
+{
+public:
+    explicit DataReaderRecorder(const ncnn::DataReader& _dr) : dr(_dr) {}
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        size_t nread = dr.read(buf, size);
+        const unsigned char* p = (const unsigned char*)buf;
+        chunks.push_back(std::vector<unsigned char>(p, p + nread));
+        return nread;
+    }
+
+public:
+    mutable std::vector<std::vector<unsigned char> > chunks;
+
+private:
+    const ncnn::DataReader& dr;
+};
+
+int convert_model_fp16(ncnn::Net& net, ncnn::Net& check_net, FILE* modelfp, std::vector<unsigned char>& model)
+{
+    std::vector<std::vector<unsigned char> > chunks;
+    {
+        ncnn::DataReaderFromStdio dr(modelfp);
+        DataReaderRecorder recorder(dr);
+        if (net.load_model(recorder) != 0)
+            return -1;
+
+        chunks.swap(recorder.chunks);
+    }
+
+    // a raw fp32 weight blob is read as a zero flag followed by the data
+    // tiny blobs are kept as is, which also keeps an all-zero single float bias from looking like a flag
+    std::vector<size_t> expected_reads;
+    model.clear();
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        const std::vector<unsigned char>& chunk = chunks[i];
+
+        bool raw_flag = chunk.size() == 4 && chunk[0] == 0 && chunk[1] == 0 && chunk[2] == 0 && chunk[3] == 0;
+        if (raw_flag && i + 1 < chunks.size() && chunks[i + 1].size() >= 16 && chunks[i + 1].size() % 4 == 0)
+        {
+            const std::vector<unsigned char>& weight = chunks[i + 1];
+            const size_t w = weight.size() / 4;
+            const size_t align_data_size = ncnn::alignSize(w * sizeof(unsigned short), 4);
+
+            const uint32_t tag = 0x01306B47;
+            const unsigned char* tagp = (const unsigned char*)&tag;
+            model.insert(model.end(), tagp, tagp + 4);
+
+            std::vector<unsigned short> weight_fp16(align_data_size / sizeof(unsigned short), 0);
+            const float* ptr = (const float*)weight.data();
+            for (size_t j = 0; j < w; j++)
+            {
+                weight_fp16[j] = ncnn::float32_to_float16(ptr[j]);
+            }
+
+            const unsigned char* p = (const unsigned char*)weight_fp16.data();
+            model.insert(model.end(), p, p + align_data_size);
+
+            expected_reads.push_back(4);
+            expected_reads.push_back(align_data_size);
+            i++;
+        }
+        else
+        {
+            model.insert(model.end(), chunk.begin(), chunk.end());
+            expected_reads.push_back(chunk.size());
+        }
+    }
+
+    // the converted weights must be consumed exactly the way they were written
+    {
+        const unsigned char* mem = model.data();
+        ncnn::DataReaderFromMemory dr(mem);
+        DataReaderRecorder recorder(dr);
+        if (check_net.load_model(recorder) != 0)
+            return -1;
+
+        if (recorder.chunks.size() != expected_reads.size())
+            return -1;
+
+        for (size_t i = 0; i < expected_reads.size(); i++)
+        {
+            if (recorder.chunks[i].size() != expected_reads[i])
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static size_t align_offset(size_t offset)
+{
+    return (offset + 15) / 16 * 16;
+}
+
+int save_model_pack(FILE* fp, uint32_t flags, const std::vector<ModelPackEntry>& entries)
+{
+    ModelPackHeader header;
+    memcpy(header.magic, model_pack_magic, sizeof(header.magic));
+    header.version = MODEL_PACK_VERSION;
+    header.flags = flags;
+    header.entry_count = (uint32_t)entries.size();
+    header.reserved = 0;
+    memset(header.ncnn_version, 0, sizeof(header.ncnn_version));
+    strncpy(header.ncnn_version, NCNN_VERSION_STRING, sizeof(header.ncnn_version) - 1);
+
+    std::vector<ModelPackEntryHeader> entry_headers(entries.size());
+
+    size_t offset = align_offset(sizeof(ModelPackHeader) + sizeof(ModelPackEntryHeader) * entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const ModelPackEntry& entry = entries[i];
+        ModelPackEntryHeader& eh = entry_headers[i];
+
+        if (entry.name.size() >= sizeof(eh.name))
+            return -1;
+
+        memset(&eh, 0, sizeof(eh));
+        memcpy(eh.name, entry.name.c_str(), entry.name.size());
+        eh.flags = entry.flags;
+        eh.elempack = 1;
+
+        // the param text is stored null terminated so that it can be parsed in place
+        eh.param_offset = offset;
+        eh.param_size = entry.param.size() + 1;
+        offset = align_offset(offset + eh.param_size);
+
+        eh.model_offset = offset;
+        eh.model_size = entry.model.size();
+        offset = align_offset(offset + eh.model_size);
+    }
+
+    const unsigned char zeros[16] = { 0 };
+    size_t written = 0;
+
+    written += fwrite(&header, 1, sizeof(header), fp);
+    written += fwrite(entry_headers.data(), 1, sizeof(ModelPackEntryHeader) * entry_headers.size(), fp);
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const ModelPackEntry& entry = entries[i];
+        const ModelPackEntryHeader& eh = entry_headers[i];
+
+        written += fwrite(zeros, 1, eh.param_offset - written, fp);
+        written += fwrite(entry.param.c_str(), 1, eh.param_size, fp);
+
+        written += fwrite(zeros, 1, eh.model_offset - written, fp);
+        written += fwrite(entry.model.data(), 1, eh.model_size, fp);
+    }
+
+    written += fwrite(zeros, 1, offset - written, fp);
+
+    return written == offset ? 0 : -1;
+}
+
+ModelPack::ModelPack()
+{
+    pack_flags = 0;
+    pack_ncnn_version[0] = '\0';
+}
+
+int ModelPack::load(FILE* fp)
+{
+    entries.clear();
+    data.clear();
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return -1;
+
+    long size = ftell(fp);
+    if (size < (long)sizeof(ModelPackHeader) || fseek(fp, 0, SEEK_SET) != 0)
+        return -1;
+
+    // one read for the whole file, the weights are referenced from this buffer afterwards
+    data.resize(size);
+    if (fread(data.data(), 1, size, fp) != (size_t)size)
+    {
+        data.clear();
+        return -1;
+    }
+
+    ModelPackHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (memcmp(header.magic, model_pack_magic, sizeof(header.magic)) != 0 || header.version != MODEL_PACK_VERSION)
+    {
+        data.clear();
+        return -1;
+    }
+
+    if (sizeof(ModelPackHeader) + sizeof(ModelPackEntryHeader) * (size_t)header.entry_count > (size_t)size)
+    {
+        data.clear();
+        return -1;
+    }
+
+    entries.resize(header.entry_count);
+    memcpy(entries.data(), data.data() + sizeof(ModelPackHeader), sizeof(ModelPackEntryHeader) * header.entry_count);
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry& e = entries[i];
+
+        // offset + size could wrap around, and the weights are read as floats in place
+        if (e.name[sizeof(e.name) - 1] != '\0'
+                || e.param_size == 0 || e.param_offset > (uint64_t)size || e.param_size > (uint64_t)size - e.param_offset
+                || e.model_offset > (uint64_t)size || e.model_size > (uint64_t)size - e.model_offset
+                || e.model_offset % 4 != 0 || e.elempack != 1
+                || data[e.param_offset + e.param_size - 1] != '\0')
+        {
+            entries.clear();
+            data.clear();
+            return -1;
+        }
+    }
+
+    pack_flags = header.flags;
+    memcpy(pack_ncnn_version, header.ncnn_version, sizeof(pack_ncnn_version));
+    pack_ncnn_version[sizeof(pack_ncnn_version) - 1] = '\0';
+
+    return 0;
+}
+
+bool ModelPack::empty() const
+{
+    return entries.empty();
+}
+
+uint32_t ModelPack::flags() const
+{
+    return pack_flags;
+}
+
+const char* ModelPack::ncnn_version() const
+{
+    return pack_ncnn_version;
+}
+
+bool ModelPack::has(const char* name) const
+{
+    return find(name) != 0;
+}
+
+const ModelPack::Entry* ModelPack::find(const char* name) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (strcmp(entries[i].name, name) == 0)
+            return &entries[i];
+    }
+
+    return 0;
+}
+
+const char* ModelPack::param(const char* name) const
+{
+    const Entry* e = find(name);
+    if (!e)
+        return 0;
+
+    return (const char*)data.data() + e->param_offset;
+}
+
+const unsigned char* ModelPack::model(const char* name) const
+{
+    const Entry* e = find(name);
+    if (!e)
+        return 0;
+
+    return data.data() + e->model_offset;
+}
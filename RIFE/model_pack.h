@@ -0,0 +1,85 @@
+// rife implemented with ncnn library
+
+#ifndef MODEL_PACK_H
+#define MODEL_PACK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// ncnn
+#include "net.h"
+
+// single-file container holding the param text and weights of every network of a model, read with one fread
+// the params are still parsed and edited on every load, and fp16 weights are expanded to fp32 by ncnn while loading
+#define MODEL_PACK_NAME "rife.pack"
+
+#define MODEL_PACK_VERSION 2
+
+// pack flags
+#define MODEL_PACK_FP16_STORAGE 1
+
+// entry flags
+#define MODEL_PACK_ENTRY_FP16_WEIGHTS 1
+
+struct ModelPackEntry
+{
+    std::string name;
+    uint32_t flags;
+    std::string param;
+    // in the order and layout ncnn's ModelBin reads them, elempack 1
+    std::vector<unsigned char> model;
+};
+
+// convert the raw fp32 weights in modelfp to ncnn's fp16 weight blobs
+// net and check_net must both have the matching param loaded, the latter is used to verify the result
+// returns 0 on success, -1 if the weights could not be converted unambiguously
+int convert_model_fp16(ncnn::Net& net, ncnn::Net& check_net, FILE* modelfp, std::vector<unsigned char>& model);
+
+// the header records flags and the ncnn version the pack is built with, each entry its own flags and weight elempack
+int save_model_pack(FILE* fp, uint32_t flags, const std::vector<ModelPackEntry>& entries);
+
+class ModelPack
+{
+public:
+    ModelPack();
+
+    int load(FILE* fp);
+
+    bool empty() const;
+
+    uint32_t flags() const;
+
+    // NCNN_VERSION_STRING of the rife-pack that wrote it
+    const char* ncnn_version() const;
+
+    bool has(const char* name) const;
+
+    const char* param(const char* name) const;
+
+    // the weights as written by save_model_pack, for a DataReaderFromMemory
+    // raw fp32 blobs are referenced in place by ncnn, so the pack must then outlive the net
+    const unsigned char* model(const char* name) const;
+
+private:
+    struct Entry
+    {
+        char name[16];
+        uint32_t flags;
+        uint32_t elempack;
+        uint64_t param_offset;
+        uint64_t param_size;
+        uint64_t model_offset;
+        uint64_t model_size;
+    };
+
+    const Entry* find(const char* name) const;
+
+    uint32_t pack_flags;
+    char pack_ncnn_version[32];
+    std::vector<Entry> entries;
+    std::vector<unsigned char> data;
+};
+
+#endif // MODEL_PACK_H
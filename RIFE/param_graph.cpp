@@ -0,0 +1,671 @@
+// rife implemented with ncnn library
+
+#include "param_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+
+int ParamGraph::parse(const char* text)
+{
+    layers.clear();
+
+    std::istringstream iss(text);
+    std::string line;
+
+    // magic
+    if (!std::getline(iss, line) || atoi(line.c_str()) != 7767517)
+        return -1;
+
+    // layer_count blob_count
+    int layer_count = 0;
+    int blob_count = 0;
+    if (!std::getline(iss, line) || sscanf(line.c_str(), "%d %d", &layer_count, &blob_count) != 2)
+        return -1;
+
+    while (std::getline(iss, line))
+    {
+        std::istringstream ls(line);
+
+        Layer layer;
+        int bottom_count = 0;
+        int top_count = 0;
+        if (!(ls >> layer.type))
+            continue;
+
+        if (!(ls >> layer.name >> bottom_count >> top_count))
+            return -1;
+
+        layer.bottoms.resize(bottom_count);
+        for (int i = 0; i < bottom_count; i++)
+        {
+            if (!(ls >> layer.bottoms[i]))
+                return -1;
+        }
+
+        layer.tops.resize(top_count);
+        for (int i = 0; i < top_count; i++)
+        {
+            if (!(ls >> layer.tops[i]))
+                return -1;
+        }
+
+        std::string param;
+        while (ls >> param)
+        {
+            layer.params.push_back(param);
+        }
+
+        layers.push_back(layer);
+    }
+
+    return (int)layers.size() == layer_count ? 0 : -1;
+}
+
+std::string ParamGraph::str() const
+{
+    size_t blob_count = 0;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        blob_count += layers[i].tops.size();
+    }
+
+    std::string text = "7767517\n" + std::to_string(layers.size()) + " " + std::to_string(blob_count) + "\n";
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer& layer = layers[i];
+
+        char head[256];
+        snprintf(head, sizeof(head), "%-24s %-24s %d %d", layer.type.c_str(), layer.name.c_str(), (int)layer.bottoms.size(), (int)layer.tops.size());
+        text += head;
+
+        for (size_t j = 0; j < layer.bottoms.size(); j++)
+            text += " " + layer.bottoms[j];
+        for (size_t j = 0; j < layer.tops.size(); j++)
+            text += " " + layer.tops[j];
+        for (size_t j = 0; j < layer.params.size(); j++)
+            text += " " + layer.params[j];
+
+        text += "\n";
+    }
+
+    return text;
+}
+
+int ParamGraph::producer(const std::string& blob) const
+{
+    for (int i = 0; i < (int)layers.size(); i++)
+    {
+        const Layer& layer = layers[i];
+        if (std::find(layer.tops.begin(), layer.tops.end(), blob) == layer.tops.end())
+            continue;
+
+        if (layer.type == "Split")
+            return producer(layer.bottoms[0]);
+
+        return i;
+    }
+
+    return -1;
+}
+
+std::vector<int> ParamGraph::consumers(const std::string& blob, std::vector<std::string>* names) const
+{
+    std::vector<int> indexes;
+
+    for (int i = 0; i < (int)layers.size(); i++)
+    {
+        const Layer& layer = layers[i];
+        if (std::find(layer.bottoms.begin(), layer.bottoms.end(), blob) == layer.bottoms.end())
+            continue;
+
+        if (layer.type == "Split")
+        {
+            for (size_t j = 0; j < layer.tops.size(); j++)
+            {
+                std::vector<int> split_indexes = consumers(layer.tops[j], names);
+                indexes.insert(indexes.end(), split_indexes.begin(), split_indexes.end());
+            }
+            continue;
+        }
+
+        indexes.push_back(i);
+        if (names)
+            names->push_back(blob);
+    }
+
+    return indexes;
+}
+
+const char* ParamGraph::get_param(const Layer& layer, int id)
+{
+    for (size_t i = 0; i < layer.params.size(); i++)
+    {
+        const std::string& param = layer.params[i];
+        size_t eq = param.find('=');
+        if (eq != std::string::npos && atoi(param.substr(0, eq).c_str()) == id)
+            return param.c_str() + eq + 1;
+    }
+
+    return 0;
+}
+
+float ParamGraph::get_param_float(const Layer& layer, int id, float default_value)
+{
+    const char* value = get_param(layer, id);
+    return value ? (float)atof(value) : default_value;
+}
+
+void ParamGraph::set_param(Layer& layer, int id, const std::string& value)
+{
+    const std::string param = std::to_string(id) + "=" + value;
+
+    for (size_t i = 0; i < layer.params.size(); i++)
+    {
+        size_t eq = layer.params[i].find('=');
+        if (eq != std::string::npos && atoi(layer.params[i].substr(0, eq).c_str()) == id)
+        {
+            layer.params[i] = param;
+            return;
+        }
+    }
+
+    layer.params.push_back(param);
+}
+
+void ParamGraph::set_param_float(Layer& layer, int id, float value)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%e", value);
+    set_param(layer, id, buf);
+}
+
+std::string ParamGraph::unique_blob_name(const std::string& base) const
+{
+    std::string name = base;
+    for (int n = 0;; n++)
+    {
+        bool used = false;
+        for (size_t i = 0; i < layers.size() && !used; i++)
+        {
+            const Layer& layer = layers[i];
+            used = std::find(layer.tops.begin(), layer.tops.end(), name) != layer.tops.end();
+        }
+
+        if (!used)
+            return name;
+
+        name = base + "_" + std::to_string(n);
+    }
+}
+
+std::string ParamGraph::unique_layer_name(const std::string& base) const
+{
+    std::string name = base;
+    for (int n = 0;; n++)
+    {
+        bool used = false;
+        for (size_t i = 0; i < layers.size() && !used; i++)
+        {
+            used = layers[i].name == name;
+        }
+
+        if (!used)
+            return name;
+
+        name = base + "_" + std::to_string(n);
+    }
+}
+
+std::string ParamGraph::insert_after(int index, const std::string& blob, Layer layer)
+{
+    const std::string top = unique_blob_name(blob + "_" + layer.type);
+
+    for (size_t i = index + 1; i < layers.size(); i++)
+    {
+        std::replace(layers[i].bottoms.begin(), layers[i].bottoms.end(), blob, top);
+    }
+
+    layer.name = unique_layer_name(layer.name.empty() ? top : layer.name);
+    layer.bottoms = std::vector<std::string>(1, blob);
+    layer.tops = std::vector<std::string>(1, top);
+
+    layers.insert(layers.begin() + index + 1, layer);
+
+    return top;
+}
+
+std::string ParamGraph::insert_scalar_mul(int index, const std::string& blob, float value)
+{
+    Layer layer;
+    layer.type = "BinaryOp";
+    layer.params.push_back("0=2");
+    layer.params.push_back("1=1");
+    set_param_float(layer, 2, value);
+
+    return insert_after(index, blob, layer);
+}
+
+static bool is_stride2_convolution(const ParamGraph::Layer& layer)
+{
+    if (layer.type != "Convolution")
+        return false;
+
+    const char* stride = ParamGraph::get_param(layer, 3);
+    return stride && atoi(stride) == 2;
+}
+
+// 0 = not feeding an IFBlock, 1 = image branch, 2 = flow branch
+// the flow branch is the last input of the Concat in front of the first stride 2 convolution, possibly after a scalar Mul/Div
+static int ifblock_input_kind(const ParamGraph& graph, const std::string& blob, int depth)
+{
+    std::vector<std::string> names;
+    std::vector<int> indexes = graph.consumers(blob, &names);
+
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[indexes[i]];
+
+        if (is_stride2_convolution(layer))
+            return 1;
+
+        if (layer.type == "BinaryOp" && layer.bottoms.size() == 1 && depth < 2)
+        {
+            int kind = ifblock_input_kind(graph, layer.tops[0], depth + 1);
+            if (kind)
+                return kind;
+        }
+
+        if (layer.type == "Concat")
+        {
+            std::vector<int> concat_consumers = graph.consumers(layer.tops[0]);
+            for (size_t j = 0; j < concat_consumers.size(); j++)
+            {
+                if (is_stride2_convolution(graph.layers[concat_consumers[j]]))
+                    return layer.bottoms.size() > 1 && layer.bottoms.back() == names[i] ? 2 : 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// the flow channels split off an upsampled IFBlock output, by a Crop of channels 0..4 or as the first output of a Slice
+static int ifblock_output_flow(const ParamGraph& graph, const std::string& blob, std::string& flow)
+{
+    std::vector<int> indexes = graph.consumers(blob);
+
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[indexes[i]];
+
+        if (layer.type == "Crop")
+        {
+            const char* starts = ParamGraph::get_param(layer, -23309);
+            const char* ends = ParamGraph::get_param(layer, -23310);
+            const char* axes = ParamGraph::get_param(layer, -23311);
+            if (starts && ends && axes && strcmp(starts, "1,0") == 0 && strcmp(ends, "1,4") == 0 && strcmp(axes, "1,0") == 0)
+            {
+                flow = layer.tops[0];
+                return indexes[i];
+            }
+        }
+
+        if (layer.type == "Slice")
+        {
+            const char* slices = ParamGraph::get_param(layer, -23300);
+            const char* axis = ParamGraph::get_param(layer, 1);
+            if (slices && strchr(slices, ',') && atoi(strchr(slices, ',') + 1) == 4 && (!axis || atoi(axis) == 0))
+            {
+                flow = layer.tops[0];
+                return indexes[i];
+            }
+        }
+    }
+
+    return -1;
+}
+
+int rescale_flownet(ParamGraph& graph, float scale)
+{
+    struct FlowMul
+    {
+        int index;
+        std::string blob;
+        float value;
+
+        bool operator<(const FlowMul& other) const
+        {
+            return index > other.index;
+        }
+    };
+
+    std::vector<FlowMul> flow_muls;
+    int downscale_count = 0;
+    int upscale_count = 0;
+
+    for (int i = 0; i < (int)graph.layers.size(); i++)
+    {
+        ParamGraph::Layer& layer = graph.layers[i];
+        if (layer.type != "Interp")
+            continue;
+
+        // fixed output size
+        if (ParamGraph::get_param(layer, 3) || ParamGraph::get_param(layer, 4))
+            continue;
+
+        const float height_scale = ParamGraph::get_param_float(layer, 1, 1.f);
+        const float width_scale = ParamGraph::get_param_float(layer, 2, 1.f);
+
+        int src = graph.producer(layer.bottoms[0]);
+        if (src != -1 && (graph.layers[src].type == "PixelShuffle" || graph.layers[src].type == "Deconvolution"))
+        {
+            FlowMul m;
+            m.index = ifblock_output_flow(graph, layer.tops[0], m.blob);
+            if (m.index == -1)
+                return -1;
+
+            m.value = 1.f / scale;
+            flow_muls.push_back(m);
+
+            ParamGraph::set_param_float(layer, 1, height_scale / scale);
+            ParamGraph::set_param_float(layer, 2, width_scale / scale);
+            upscale_count++;
+            continue;
+        }
+
+        int kind = ifblock_input_kind(graph, layer.tops[0], 0);
+        if (kind == 0)
+            continue;
+
+        if (kind == 2)
+        {
+            FlowMul m;
+            m.index = i;
+            m.blob = layer.tops[0];
+            m.value = scale;
+            flow_muls.push_back(m);
+        }
+
+        ParamGraph::set_param_float(layer, 1, height_scale * scale);
+        ParamGraph::set_param_float(layer, 2, width_scale * scale);
+        downscale_count++;
+    }
+
+    if (downscale_count == 0 || upscale_count == 0)
+        return -1;
+
+    // from the back so that the recorded indexes stay valid
+    std::sort(flow_muls.begin(), flow_muls.end());
+    for (size_t i = 0; i < flow_muls.size(); i++)
+    {
+        graph.insert_scalar_mul(flow_muls[i].index, flow_muls[i].blob, flow_muls[i].value);
+    }
+
+    return 0;
+}
+
+// the blob read in place of blob when it is an output of Split layers
+static std::string split_source(const ParamGraph& graph, const std::string& blob)
+{
+    for (size_t i = 0; i < graph.layers.size(); i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[i];
+        if (layer.type == "Split" && std::find(layer.tops.begin(), layer.tops.end(), blob) != layer.tops.end())
+            return split_source(graph, layer.bottoms[0]);
+    }
+
+    return blob;
+}
+
+// whether blob is an output of one of the layers before layers[index]
+static bool produced_before(const ParamGraph& graph, const std::string& blob, int index)
+{
+    for (int i = 0; i < index; i++)
+    {
+        const std::vector<std::string>& tops = graph.layers[i].tops;
+        if (std::find(tops.begin(), tops.end(), blob) != tops.end())
+            return true;
+    }
+
+    return false;
+}
+
+// 0 or 1 when the rife.Warp layers[index] reads flow channels 0..2 or 2..4 through a Crop of its own, otherwise -1
+// the index of the Crop and the blob it reads, looking through Split layers, are stored in crop and source
+static int warp_flow_half(const ParamGraph& graph, int index, int& crop, std::string& source)
+{
+    const ParamGraph::Layer& warp = graph.layers[index];
+    if (warp.type != "rife.Warp" || warp.bottoms.size() != 2 || warp.tops.size() != 1)
+        return -1;
+
+    crop = graph.producer(warp.bottoms[1]);
+    if (crop == -1)
+        return -1;
+
+    const ParamGraph::Layer& layer = graph.layers[crop];
+    if (layer.type != "Crop" || layer.tops.size() != 1 || layer.tops[0] != warp.bottoms[1])
+        return -1;
+
+    const char* starts = ParamGraph::get_param(layer, -23309);
+    const char* ends = ParamGraph::get_param(layer, -23310);
+    const char* axes = ParamGraph::get_param(layer, -23311);
+    if (!starts || !ends || !axes || strcmp(axes, "1,0") != 0)
+        return -1;
+
+    source = split_source(graph, layer.bottoms[0]);
+
+    if (strcmp(starts, "1,0") == 0 && strcmp(ends, "1,2") == 0)
+        return 0;
+    if (strcmp(starts, "1,2") == 0 && strcmp(ends, "1,4") == 0)
+        return 1;
+
+    return -1;
+}
+
+int fuse_warp_pairs(ParamGraph& graph)
+{
+    int count = 0;
+
+    for (int i = 0; i < (int)graph.layers.size(); i++)
+    {
+        int crop_i = -1;
+        std::string source_i;
+        const int half_i = warp_flow_half(graph, i, crop_i, source_i);
+        if (half_i == -1)
+            continue;
+
+        for (int j = i + 1; j < (int)graph.layers.size(); j++)
+        {
+            int crop_j = -1;
+            std::string source_j;
+            const int half_j = warp_flow_half(graph, j, crop_j, source_j);
+            if (half_j == -1 || half_j == half_i || source_j != source_i)
+                continue;
+
+            // the fused layer takes the place of the earlier warp when the image of the later one is ready by then,
+            // otherwise of the later warp as long as the earlier output is not read in between
+            int index = i;
+            if (!produced_before(graph, graph.layers[j].bottoms[0], i))
+            {
+                const std::string& top_i = graph.layers[i].tops[0];
+                for (int k = i + 1; k < j && index != -1; k++)
+                {
+                    const std::vector<std::string>& bottoms = graph.layers[k].bottoms;
+                    if (std::find(bottoms.begin(), bottoms.end(), top_i) != bottoms.end())
+                        index = -1;
+                }
+                if (index == -1)
+                    break;
+
+                index = j;
+            }
+
+            const int warp0 = half_i == 0 ? i : j;
+            const int warp1 = half_i == 0 ? j : i;
+
+            ParamGraph::Layer warp2;
+            warp2.type = "rife.Warp2";
+            warp2.name = graph.layers[warp0].name + "_" + graph.layers[warp1].name;
+            warp2.bottoms.push_back(graph.layers[warp0].bottoms[0]);
+            warp2.bottoms.push_back(graph.layers[warp1].bottoms[0]);
+            warp2.bottoms.push_back(graph.layers[crop_i].bottoms[0]);
+            warp2.tops.push_back(graph.layers[warp0].tops[0]);
+            warp2.tops.push_back(graph.layers[warp1].tops[0]);
+
+            // the flow is read once, through the blob of the earlier Crop, so the Split output feeding the later one goes away
+            const std::string unused = graph.layers[crop_j].bottoms[0];
+            for (size_t k = 0; k < graph.layers.size(); k++)
+            {
+                ParamGraph::Layer& layer = graph.layers[k];
+                if (layer.type == "Split" && layer.tops.size() > 1)
+                    layer.tops.erase(std::remove(layer.tops.begin(), layer.tops.end(), unused), layer.tops.end());
+            }
+
+            graph.layers[index] = warp2;
+
+            // from the back so that the indexes stay valid
+            int removed[3] = {index == i ? j : i, crop_i, crop_j};
+            std::sort(removed, removed + 3);
+            for (int k = 2; k >= 0; k--)
+            {
+                graph.layers.erase(graph.layers.begin() + removed[k]);
+            }
+
+            count++;
+            i = -1;
+            break;
+        }
+    }
+
+    return count;
+}
+
+int broadcast_timestep(ParamGraph& graph, const std::string& timestep, const std::string& image)
+{
+    // a BinaryOp broadcasts the scalar by itself, every other reader needs a plane
+    std::vector<std::string> names;
+    std::vector<int> indexes = graph.consumers(timestep, &names);
+
+    std::vector<int> plane_readers;
+    std::vector<std::string> plane_names;
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[indexes[i]];
+        if (layer.type == "BinaryOp" && layer.bottoms.size() == 2)
+            continue;
+
+        plane_readers.push_back(indexes[i]);
+        plane_names.push_back(names[i]);
+    }
+
+    if (plane_readers.empty())
+        return 0;
+
+    // the image is read through a Split, which gets one more output for the plane
+    int image_split = -1;
+    for (int i = 0; i < (int)graph.layers.size() && image_split == -1; i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[i];
+        if (layer.type == "Split" && layer.bottoms[0] == image)
+            image_split = i;
+    }
+    if (image_split == -1 || image_split > *std::min_element(plane_readers.begin(), plane_readers.end()))
+        return -1;
+
+    // the readers of the plane give up their blobs, the timestep is then read once by the plane
+    std::string scalar = timestep;
+    for (size_t i = 0; i < graph.layers.size(); i++)
+    {
+        ParamGraph::Layer& layer = graph.layers[i];
+        if (layer.type != "Split" || layer.bottoms[0] != timestep)
+            continue;
+
+        for (size_t j = 0; j < plane_names.size(); j++)
+        {
+            layer.tops.erase(std::remove(layer.tops.begin(), layer.tops.end(), plane_names[j]), layer.tops.end());
+        }
+
+        if (layer.tops.empty())
+        {
+            graph.layers.erase(graph.layers.begin() + i);
+            for (size_t j = 0; j < plane_readers.size(); j++)
+            {
+                if (plane_readers[j] > (int)i)
+                    plane_readers[j]--;
+            }
+            if (image_split > (int)i)
+                image_split--;
+        }
+        else
+        {
+            scalar = graph.unique_blob_name(timestep + "_scalar");
+            layer.tops.push_back(scalar);
+        }
+        break;
+    }
+
+    const std::string image_blob = graph.unique_blob_name(image + "_timestep");
+    graph.layers[image_split].tops.push_back(image_blob);
+
+    // plane = image[0] * 0 + timestep
+    ParamGraph::Layer crop;
+    crop.type = "Crop";
+    crop.name = graph.unique_layer_name(timestep + "_crop");
+    crop.bottoms.push_back(image_blob);
+    crop.tops.push_back(graph.unique_blob_name(timestep + "_crop"));
+    crop.params.push_back("-23309=1,0");
+    crop.params.push_back("-23310=1,1");
+    crop.params.push_back("-23311=1,0");
+
+    ParamGraph::Layer zero;
+    zero.type = "BinaryOp";
+    zero.name = graph.unique_layer_name(timestep + "_zero");
+    zero.bottoms.push_back(crop.tops[0]);
+    zero.tops.push_back(graph.unique_blob_name(timestep + "_zero"));
+    zero.params.push_back("0=2");
+    zero.params.push_back("1=1");
+    ParamGraph::set_param_float(zero, 2, 0.f);
+
+    ParamGraph::Layer plane;
+    plane.type = "BinaryOp";
+    plane.name = graph.unique_layer_name(timestep + "_plane");
+    plane.bottoms.push_back(zero.tops[0]);
+    plane.bottoms.push_back(scalar);
+    plane.tops.push_back(graph.unique_blob_name(timestep + "_plane"));
+    plane.params.push_back("0=0");
+
+    std::vector<ParamGraph::Layer> layers;
+    layers.push_back(crop);
+    layers.push_back(zero);
+    layers.push_back(plane);
+
+    if (plane_readers.size() == 1)
+    {
+        std::replace(graph.layers[plane_readers[0]].bottoms.begin(), graph.layers[plane_readers[0]].bottoms.end(), plane_names[0], plane.tops[0]);
+    }
+    else
+    {
+        ParamGraph::Layer split;
+        split.type = "Split";
+        split.name = graph.unique_layer_name(timestep + "_plane_split");
+        split.bottoms.push_back(plane.tops[0]);
+        for (size_t i = 0; i < plane_readers.size(); i++)
+        {
+            split.tops.push_back(plane.tops[0] + "_splitncnn_" + std::to_string(i));
+
+            std::vector<std::string>& bottoms = graph.layers[plane_readers[i]].bottoms;
+            std::replace(bottoms.begin(), bottoms.end(), plane_names[i], split.tops[i]);
+        }
+        layers.push_back(split);
+    }
+
+    // right before the first reader, after both inputs
+    const int first = *std::min_element(plane_readers.begin(), plane_readers.end());
+    graph.layers.insert(graph.layers.begin() + first, layers.begin(), layers.end());
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+// rife implemented with ncnn library
+
+#ifndef PARAM_GRAPH_H
+#define PARAM_GRAPH_H
+
+#include <string>
+#include <vector>
+
+// editable in-memory form of an ncnn text param, so that a model can be adjusted before it is loaded
+class ParamGraph
+{
+public:
+    struct Layer
+    {
+        std::string type;
+        std::string name;
+        std::vector<std::string> bottoms;
+        std::vector<std::string> tops;
+        std::vector<std::string> params;
+    };
+
+    // returns 0 on success, -1 on malformed text
+    int parse(const char* text);
+
+    // text suitable for ncnn::Net::load_param_mem
+    std::string str() const;
+
+    // index of the layer producing blob, looking through Split layers, or -1
+    int producer(const std::string& blob) const;
+
+    // indexes of the layers consuming blob, looking through Split layers
+    // the blob name each of them reads is stored in names when given
+    std::vector<int> consumers(const std::string& blob, std::vector<std::string>* names = 0) const;
+
+    // value of param id in layer, or 0 if it is not set
+    static const char* get_param(const Layer& layer, int id);
+    static float get_param_float(const Layer& layer, int id, float default_value);
+    static void set_param(Layer& layer, int id, const std::string& value);
+    static void set_param_float(Layer& layer, int id, float value);
+
+    // insert layer right after layers[index] so that it reads blob and every later consumer of blob reads its output instead
+    // layer.bottoms and layer.tops are filled in, the name of the new blob is returned
+    std::string insert_after(int index, const std::string& blob, Layer layer);
+
+    // insert a BinaryOp multiplying blob by a scalar, see insert_after
+    std::string insert_scalar_mul(int index, const std::string& blob, float value);
+
+    // base, or base with a numeric suffix, so that it is not yet in use
+    std::string unique_blob_name(const std::string& base) const;
+    std::string unique_layer_name(const std::string& base) const;
+
+public:
+    std::vector<Layer> layers;
+};
+
+// rescale the flow estimation pyramid of a rife v4 flownet by scale, as the scale argument of the reference implementation
+// the input of every IFBlock is resized by scale relative to the original model and the flow magnitude is adjusted to match
+// returns 0 on success, -1 if the pyramid could not be identified
+int rescale_flownet(ParamGraph& graph, float scale);
+
+// replace each pair of rife.Warp layers reading channels 0..2 and 2..4 of the same flow through Crop layers by a single rife.Warp2
+// returns the number of pairs replaced
+int fuse_warp_pairs(ParamGraph& graph);
+
+// let the timestep input of a rife v4 flownet be a single value instead of a plane of the size of the image input
+// BinaryOp readers broadcast it as they are, the others read a plane built in the graph from the image
+// returns 0 on success, -1 if the image input is not read through a Split
+int broadcast_timestep(ParamGraph& graph, const std::string& timestep, const std::string& image);
+
+#endif // PARAM_GRAPH_H
@@ -22,38 +22,370 @@
     SOFTWARE.
 */
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <semaphore>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include "VapourSynth4.h"
 #include "VSHelper4.h"
 
+#include "compare.h"
+#include "frame_codec.h"
 #include "rife.h"
 
+// ncnn
+#include "benchmark.h"
+
 using namespace std::literals;
 
 static std::atomic<int> numGPUInstances{ 0 };
 
+struct PrecisionStats final {
+    std::mutex lock;
+    double sum;
+    double min;
+    int64_t frames;
+};
+
+// hashes of the most recently requested source frames, each frame is part of two consecutive pairs
+struct HashCache final {
+    std::mutex lock;
+    int frame[16];
+    uint64_t hash[16];
+};
+
+// interpolated frames, least recently used first
+struct FrameCache final {
+    std::mutex lock;
+    std::list<std::pair<int, const VSFrame*>> frames;
+    std::unordered_map<int, std::list<std::pair<int, const VSFrame*>>::iterator> index;
+    size_t size;
+    size_t capacity;
+};
+
+// interpolated frames compressed into files of dir named after a hash of their inputs, kept across runs,
+// index holds the keys and sizes of the files so that a miss costs no file system access, least recently used first
+struct DiskCache final {
+    std::mutex lock;
+    std::string dir;
+    // hash of the model and of every option that changes the interpolation
+    uint64_t salt;
+    std::list<std::pair<uint64_t, uintmax_t>> files;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, uintmax_t>>::iterator> index;
+    uintmax_t size;
+    // 0 for no limit
+    uintmax_t capacity;
+    std::atomic<bool> writeFailed;
+};
+
+// the inputs of a cached frame, stored in front of it and compared on load,
+// so that two inputs with the same 64-bit file name never return each other's frame
+struct DiskCacheEntry final {
+    uint32_t version;
+    uint32_t timestep;
+    uint64_t salt;
+    uint64_t hash0;
+    uint64_t hash1;
+};
+
+static constexpr uint32_t diskCacheVersion{ 2 };
+
+// latencies in milliseconds, 16 buckets per doubling from 1 us to about 17 s, so that percentiles are within 5%
+struct Histogram final {
+    int64_t counts[16 * 24];
+    int64_t samples;
+    double sum;
+    double max;
+};
+
+// stages of RIFEProfile in the order of process
+static constexpr std::pair<const char*, double RIFEProfile::*> profileStages[]{
+    { "convert", &RIFEProfile::convert },
+    { "upload", &RIFEProfile::upload },
+    { "scene_change", &RIFEProfile::scene_change },
+    { "preproc", &RIFEProfile::preproc },
+    { "flownet", &RIFEProfile::flownet },
+    { "contextnet", &RIFEProfile::contextnet },
+    { "fusionnet", &RIFEProfile::fusionnet },
+    { "postproc", &RIFEProfile::postproc },
+    { "download", &RIFEProfile::download },
+};
+
+// what happened to the output frames, written to path when the filter is freed
+struct Stats final {
+    std::mutex lock;
+    std::string path;
+    int gpuThread;
+    int64_t interpolated;
+    int64_t blended;
+    int64_t source;
+    int64_t cached;
+    int64_t diskCached;
+    int64_t sceneChange;
+    int64_t skipped;
+    int64_t bypassed;
+    int64_t unchanged;
+    // frames waiting for or holding a gpu_thread slot, sampled whenever one starts waiting
+    std::atomic<int> pending;
+    int64_t depthSum;
+    int64_t depthSamples;
+    int depthMax;
+    Histogram frame;
+    Histogram wait;
+    Histogram stages[std::size(profileStages)];
+    // most bytes a single frame held in the blob and staging allocators
+    size_t blobPeak;
+    size_t stagingPeak;
+};
+
+// a span of a frame on the thread it ran on, times in ncnn::get_current_time milliseconds
+struct TraceEvent final {
+    const char* name;
+    int frame;
+    std::thread::id thread;
+    double start;
+    double end;
+};
+
+// spans of every frame in Chrome trace event format, written to path when the filter is freed
+struct Trace final {
+    std::mutex lock;
+    std::string path;
+    double start;
+    std::vector<TraceEvent> events;
+};
+
 struct RIFEData final {
     VSNode* node;
-    VSNode* psnr;
     VSVideoInfo vi;
     bool sceneChange;
+    // sc_threshold with sc_gpu, tested on the host once per frame when only regions of it are interpolated
+    float scThreshold;
     bool skip;
     double skipThreshold;
+    bool bypass;
+    float bypassThreshold;
+    bool dirty;
+    float dirtyThreshold;
+    int dirtyMargin;
+    bool letterbox;
+    float letterboxThreshold;
+    int padding;
+    bool profile;
     int64_t factor;
     int64_t factorNum;
     int64_t factorDen;
     std::unique_ptr<RIFE> rife;
+    std::unique_ptr<RIFE> reference;
+    std::unique_ptr<PrecisionStats> precisionStats;
+    std::unique_ptr<HashCache> hashCache;
+    std::unique_ptr<FrameCache> frameCache;
+    std::unique_ptr<DiskCache> diskCache;
+    std::unique_ptr<Stats> stats;
+    std::unique_ptr<Trace> trace;
     std::unique_ptr<std::counting_semaphore<>> semaphore;
 };
 
-static void filter(const VSFrame* src0, const VSFrame* src1, VSFrame* dst,
-                   const float timestep, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+static void histogramAdd(Histogram& h, const double ms) noexcept {
+    const auto bucket{ ms > 0.001 ? std::min(static_cast<int>(std::log2(ms * 1000.0) * 16.0), static_cast<int>(std::size(h.counts)) - 1) : 0 };
+    h.counts[bucket]++;
+    h.samples++;
+    h.sum += ms;
+    h.max = std::max(h.max, ms);
+}
+
+// upper edge of the bucket holding the p-th sample
+static double histogramPercentile(const Histogram& h, const double p) noexcept {
+    const auto target{ std::max(static_cast<int64_t>(std::ceil(p * h.samples)), int64_t{ 1 }) };
+    int64_t seen{};
+
+    for (size_t i{ 0 }; i < std::size(h.counts); i++) {
+        seen += h.counts[i];
+        if (seen >= target && i + 1 < std::size(h.counts))
+            return std::min(std::exp2((i + 1) / 16.0) / 1000.0, h.max);
+    }
+
+    return h.max;
+}
+
+static void writeHistogram(std::ostream& os, const char* name, const Histogram& h) {
+    os << "    \"" << name << "\": { \"samples\": " << h.samples << ", \"mean\": " << h.sum / h.samples
+       << ", \"p50\": " << histogramPercentile(h, 0.5) << ", \"p90\": " << histogramPercentile(h, 0.9)
+       << ", \"p99\": " << histogramPercentile(h, 0.99) << ", \"max\": " << h.max << " }";
+}
+
+static void writeStats(const Stats* stats, const RIFEMemory& memory) {
+    std::ofstream ofs{ stats->path };
+    if (!ofs.is_open()) {
+        std::cerr << "RIFE: failed to write stats to " << stats->path << std::endl;
+        return;
+    }
+
+    ofs << "{\n"
+        << "  \"gpu_thread\": " << stats->gpuThread << ",\n"
+        << "  \"frames\": {\n"
+        << "    \"total\": " << stats->interpolated + stats->blended + stats->source + stats->cached + stats->diskCached + stats->sceneChange +
+                              stats->skipped + stats->bypassed + stats->unchanged << ",\n"
+        << "    \"interpolated\": " << stats->interpolated << ",\n"
+        << "    \"blended\": " << stats->blended << ",\n"
+        << "    \"source\": " << stats->source << ",\n"
+        << "    \"cached\": " << stats->cached << ",\n"
+        << "    \"disk_cache\": " << stats->diskCached << ",\n"
+        << "    \"scene_change\": " << stats->sceneChange << ",\n"
+        << "    \"skip\": " << stats->skipped << ",\n"
+        << "    \"bypass\": " << stats->bypassed << ",\n"
+        << "    \"unchanged\": " << stats->unchanged << "\n"
+        << "  },\n"
+        << "  \"queue_depth\": { \"mean\": " << (stats->depthSamples ? static_cast<double>(stats->depthSum) / stats->depthSamples : 0.0)
+        << ", \"max\": " << stats->depthMax << " },\n"
+        << "  \"memory_mb\": {\n"
+        << "    \"frame\": { \"blob_peak\": " << stats->blobPeak / 1048576.0 << ", \"staging_peak\": " << stats->stagingPeak / 1048576.0 << " },\n"
+        << "    \"device\": { \"blob_peak\": " << memory.blob_peak / 1048576.0 << ", \"staging_peak\": " << memory.staging_peak / 1048576.0 << " },\n"
+        << "    \"weights\": { \"flownet\": " << memory.flownet / 1048576.0 << ", \"contextnet\": " << memory.contextnet / 1048576.0
+        << ", \"fusionnet\": " << memory.fusionnet / 1048576.0 << " }\n"
+        << "  },\n"
+        << "  \"latency_ms\": {";
+
+    auto first{ true };
+    auto write{ [&](const char* name, const Histogram& h) {
+        if (h.samples == 0)
+            return;
+
+        ofs << (first ? "\n" : ",\n");
+        writeHistogram(ofs, name, h);
+        first = false;
+    } };
+
+    write("frame", stats->frame);
+    write("wait", stats->wait);
+    for (size_t i{ 0 }; i < std::size(profileStages); i++)
+        write(profileStages[i].first, stats->stages[i]);
+
+    ofs << (first ? "}\n" : "\n  }\n") << "}" << std::endl;
+}
+
+static const char* stageName(double RIFEProfile::*stage) noexcept {
+    if (stage == &RIFEProfile::record)
+        return "record";
+    if (stage == &RIFEProfile::gpu)
+        return "gpu";
+
+    for (auto&& s : profileStages) {
+        if (s.second == stage)
+            return s.first;
+    }
+
+    return "";
+}
+
+// the request of a frame goes from the thread that asked for it to the one that returns it, so it is
+// written as an async span, everything else as a complete span on the thread it ran on
+static void writeTrace(const Trace* trace) {
+    std::ofstream ofs{ trace->path };
+    if (!ofs.is_open()) {
+        std::cerr << "RIFE: failed to write trace to " << trace->path << std::endl;
+        return;
+    }
+
+    std::unordered_map<std::thread::id, int> threads;
+    for (auto&& e : trace->events)
+        threads.emplace(e.thread, static_cast<int>(threads.size()) + 1);
+
+    ofs << "{\"traceEvents\":[\n";
+
+    auto first{ true };
+    auto next{ [&] {
+        ofs << (first ? "" : ",\n");
+        first = false;
+    } };
+
+    for (auto&& [thread, tid] : threads) {
+        next();
+        ofs << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+    }
+
+    ofs.precision(3);
+    ofs.setf(std::ios::fixed);
+
+    for (auto&& e : trace->events) {
+        const auto tid{ threads[e.thread] };
+        const auto ts{ (e.start - trace->start) * 1000.0 };
+
+        next();
+        if (e.name == "request"sv) {
+            ofs << "{\"name\":\"frame " << e.frame << "\",\"cat\":\"request\",\"ph\":\"b\",\"id\":" << e.frame << ",\"pid\":1,\"tid\":" << tid
+                << ",\"ts\":" << ts << "},\n";
+            ofs << "{\"name\":\"frame " << e.frame << "\",\"cat\":\"request\",\"ph\":\"e\",\"id\":" << e.frame << ",\"pid\":1,\"tid\":" << tid
+                << ",\"ts\":" << (e.end - trace->start) * 1000.0 << "}";
+        } else {
+            ofs << "{\"name\":\"" << e.name << "\",\"cat\":\"rife\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts
+                << ",\"dur\":" << (e.end - e.start) * 1000.0 << ",\"args\":{\"frame\":" << e.frame << "}}";
+        }
+    }
+
+    ofs << "\n]}" << std::endl;
+}
+
+static void traceAdd(const RIFEData* const VS_RESTRICT d, std::vector<TraceEvent>& events) {
+    std::lock_guard<std::mutex> guard{ d->trace->lock };
+    d->trace->events.insert(d->trace->events.end(), events.begin(), events.end());
+}
+
+// waits for a free gpu_thread slot, adding the time spent waiting to wait and a span to events when they are given
+static void acquire(const RIFEData* const VS_RESTRICT d, double* wait, std::vector<TraceEvent>* events) noexcept {
+    if (d->stats) {
+        const auto depth{ ++d->stats->pending };
+
+        std::lock_guard<std::mutex> guard{ d->stats->lock };
+        d->stats->depthSum += depth;
+        d->stats->depthSamples++;
+        d->stats->depthMax = std::max(d->stats->depthMax, depth);
+    }
+
+    if (!wait && !events) {
+        d->semaphore->acquire();
+        return;
+    }
+
+    const auto start{ ncnn::get_current_time() };
+    d->semaphore->acquire();
+    const auto end{ ncnn::get_current_time() };
+
+    if (wait)
+        *wait += end - start;
+
+    if (events)
+        events->push_back({ "wait", -1, std::this_thread::get_id(), start, end });
+}
+
+static void release(const RIFEData* const VS_RESTRICT d) noexcept {
+    d->semaphore->release();
+
+    if (d->stats)
+        --d->stats->pending;
+}
+
+// without regions the whole frame is interpolated, otherwise dst starts as a copy of src0 and
+// only the inner rect of each region is replaced by the interpolation of its outer rect
+static int filter(const VSFrame* src0, const VSFrame* src1, VSFrame* dst, const float timestep, const std::vector<DirtyRegion>& regions,
+                  RIFEProfile* profile, double* wait, std::vector<TraceEvent>* events, const RIFEData* const VS_RESTRICT d,
+                  const VSAPI* vsapi) noexcept {
     const auto width{ vsapi->getFrameWidth(src0, 0) };
     const auto height{ vsapi->getFrameHeight(src0, 0) };
     const auto stride{ vsapi->getStride(src0, 0) / d->vi.format.bytesPerSample };
@@ -67,12 +399,424 @@ static void filter(const VSFrame* src0, const VSFrame* src1, VSFrame* dst,
     auto dstG{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, 1)) };
     auto dstB{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, 2)) };
 
-    d->semaphore->acquire();
-    d->rife->process(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, width, height, stride, timestep);
-    d->semaphore->release();
+    if (regions.empty()) {
+        acquire(d, wait, events);
+        auto ret{ d->rife->process(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, width, height, stride, timestep, profile) };
+        release(d);
+
+        return ret;
+    }
+
+    // a region alone can differ far more than the frame it is part of, so the whole frame is tested
+    if (d->scThreshold > 0.0f) {
+        const float* planes0[3]{ src0R, src0G, src0B };
+        const float* planes1[3]{ src1R, src1G, src1B };
+        if (sceneChangeBlocks(planes0, planes1, width, height, stride, d->scThreshold) > 0.5f)
+            return RIFE_SCENE_CHANGE;
+    }
+
+    for (auto plane{ 0 }; plane < 3; plane++)
+        vsh::bitblt(vsapi->getWritePtr(dst, plane), vsapi->getStride(dst, plane), vsapi->getReadPtr(src0, plane), vsapi->getStride(src0, plane),
+                    width * sizeof(float), height);
+
+    std::vector<float> region;
+
+    for (auto&& r : regions) {
+        const auto offset{ r.outer.y * stride + r.outer.x };
+        // process() uses the same stride for its input and output
+        const auto planeSize{ static_cast<size_t>(stride) * r.outer.height };
+        region.resize(planeSize * 3);
+
+        acquire(d, wait, events);
+        auto ret{ d->rife->process(src0R + offset, src0G + offset, src0B + offset, src1R + offset, src1G + offset, src1B + offset,
+                                   region.data(), region.data() + planeSize, region.data() + planeSize * 2,
+                                   r.outer.width, r.outer.height, stride, timestep, profile, false) };
+        release(d);
+
+        if (ret != 0)
+            return ret;
+
+        float* dstPlanes[3]{ dstR, dstG, dstB };
+        for (auto plane{ 0 }; plane < 3; plane++) {
+            auto regionp{ region.data() + planeSize * plane + (r.inner.y - r.outer.y) * stride + (r.inner.x - r.outer.x) };
+            vsh::bitblt(dstPlanes[plane] + r.inner.y * stride + r.inner.x, stride * sizeof(float), regionp, stride * sizeof(float),
+                        r.inner.width * sizeof(float), r.inner.height);
+        }
+    }
+
+    return 0;
+}
+
+static uint64_t cachedFrameHash(const int n, const float* const planes[3], const RIFEData* const VS_RESTRICT d, const ptrdiff_t stride) noexcept {
+    auto cache{ d->hashCache.get() };
+    const auto slot{ n % 16 };
+
+    {
+        std::lock_guard<std::mutex> guard{ cache->lock };
+        if (cache->frame[slot] == n)
+            return cache->hash[slot];
+    }
+
+    const auto hash{ frameHash(planes, d->vi.width, d->vi.height, stride) };
+
+    {
+        std::lock_guard<std::mutex> guard{ cache->lock };
+        cache->frame[slot] = n;
+        cache->hash[slot] = hash;
+    }
+
+    return hash;
+}
+
+// 0 = interpolate, 1 = the pair is identical and src0 is returned, 2 = the pair is nearly static and is blended
+static int bypassDecision(const int frameNum, const float* const planes0[3], const float* const planes1[3],
+                          const RIFEData* const VS_RESTRICT d, const ptrdiff_t stride) noexcept {
+    if (cachedFrameHash(frameNum, planes0, d, stride) == cachedFrameHash(frameNum + 1, planes1, d, stride))
+        return 1;
+
+    if (d->bypassThreshold > 0.0f && sampledMaxDiff(planes0, planes1, d->vi.width, d->vi.height, stride) <= d->bypassThreshold)
+        return 2;
+
+    return 0;
+}
+
+static void blend(const float* const planes0[3], const float* const planes1[3], VSFrame* dst,
+                  const float timestep, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+    const auto stride{ vsapi->getStride(dst, 0) / d->vi.format.bytesPerSample };
+
+    for (auto plane{ 0 }; plane < 3; plane++) {
+        auto src0p{ planes0[plane] };
+        auto src1p{ planes1[plane] };
+        auto dstp{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, plane)) };
+
+        for (auto y{ 0 }; y < d->vi.height; y++) {
+            for (auto x{ 0 }; x < d->vi.width; x++)
+                dstp[x] = src0p[x] + (src1p[x] - src0p[x]) * timestep;
+
+            src0p += stride;
+            src1p += stride;
+            dstp += stride;
+        }
+    }
+}
+
+static size_t frameSize(const VSFrame* frame, const VSAPI* vsapi) noexcept {
+    return static_cast<size_t>(vsapi->getStride(frame, 0)) * vsapi->getFrameHeight(frame, 0) * 3;
+}
+
+static const VSFrame* cacheLookup(const int n, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+    auto cache{ d->frameCache.get() };
+    std::lock_guard<std::mutex> guard{ cache->lock };
+
+    auto it{ cache->index.find(n) };
+    if (it == cache->index.end())
+        return nullptr;
+
+    cache->frames.splice(cache->frames.end(), cache->frames, it->second);
+    return vsapi->addFrameRef(it->second->second);
+}
+
+static void cacheInsert(const int n, const VSFrame* frame, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+    auto cache{ d->frameCache.get() };
+    const auto size{ frameSize(frame, vsapi) };
+    if (size > cache->capacity)
+        return;
+
+    std::lock_guard<std::mutex> guard{ cache->lock };
+
+    // another thread may have produced the same frame meanwhile
+    if (cache->index.count(n))
+        return;
+
+    while (cache->size + size > cache->capacity) {
+        auto&& oldest{ cache->frames.front() };
+        cache->size -= frameSize(oldest.second, vsapi);
+        cache->index.erase(oldest.first);
+        vsapi->freeFrame(oldest.second);
+        cache->frames.pop_front();
+    }
+
+    cache->index.emplace(n, cache->frames.emplace(cache->frames.end(), n, vsapi->addFrameRef(frame)));
+    cache->size += size;
+}
+
+static uint64_t hashMix(uint64_t h) noexcept {
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// FNV-1a, stable across builds unlike std::hash
+static uint64_t stringHash(const std::string& s) noexcept {
+    uint64_t h{ 0xcbf29ce484222325ULL };
+    for (auto c : s)
+        h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    return h;
+}
+
+// size and modification time of each file a model can be loaded from, so that replaced weights or a new rife.pack
+// in the same folder do not share entries with the old ones
+static std::string weightFiles(const std::string& modelPath) {
+    std::string files;
+
+    for (auto&& name : { "rife.pack", "flownet.param", "flownet.bin", "contextnet.param", "contextnet.bin", "fusionnet.param", "fusionnet.bin" }) {
+        const auto path{ std::filesystem::path{ modelPath } / name };
+        std::error_code ec;
+        const auto size{ std::filesystem::file_size(path, ec) };
+        if (ec)
+            continue;
+
+        const auto time{ std::filesystem::last_write_time(path, ec) };
+        files += std::string{ name } + " " + std::to_string(size) + " " + std::to_string(ec ? 0 : time.time_since_epoch().count()) + ";";
+    }
+
+    return files;
+}
+
+static DiskCacheEntry diskCacheEntry(const int frameNum, const float* const planes0[3], const float* const planes1[3], const float timestep,
+                                     const RIFEData* const VS_RESTRICT d, const ptrdiff_t stride) noexcept {
+    return { diskCacheVersion, std::bit_cast<uint32_t>(timestep), d->diskCache->salt, cachedFrameHash(frameNum, planes0, d, stride),
+             cachedFrameHash(frameNum + 1, planes1, d, stride) };
+}
+
+static uint64_t diskCacheKey(const DiskCacheEntry& entry) noexcept {
+    auto key{ entry.salt };
+    key = hashMix(key ^ entry.hash0);
+    key = hashMix(key ^ entry.hash1);
+    return hashMix(key ^ entry.timestep);
+}
+
+static std::string diskCachePath(const DiskCache* cache, const uint64_t key) {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.rifc", static_cast<unsigned long long>(key));
+    return cache->dir + "/" + name;
+}
+
+static void diskCacheErase(DiskCache* cache, const uint64_t key) noexcept {
+    if (auto it{ cache->index.find(key) }; it != cache->index.end()) {
+        cache->size -= it->second->second;
+        cache->files.erase(it->second);
+        cache->index.erase(it);
+    }
+}
+
+// removes the least recently used files until size more bytes fit, with cache->lock held
+static void diskCacheEvict(DiskCache* cache, const uintmax_t size) noexcept {
+    while (cache->capacity && !cache->files.empty() && cache->size + size > cache->capacity) {
+        const auto key{ cache->files.front().first };
+        std::error_code ec;
+        std::filesystem::remove(diskCachePath(cache, key), ec);
+        diskCacheErase(cache, key);
+    }
+}
+
+// a new frame with the planes stored for entry, nullptr if there is none or it cannot be read
+static VSFrame* diskCacheLoad(const DiskCacheEntry& entry, const VSFrame* src0, const RIFEData* const VS_RESTRICT d, VSCore* core,
+                              const VSAPI* vsapi) noexcept {
+    auto cache{ d->diskCache.get() };
+    const auto key{ diskCacheKey(entry) };
+
+    {
+        std::lock_guard<std::mutex> guard{ cache->lock };
+        if (!cache->index.count(key))
+            return nullptr;
+    }
+
+    const auto path{ diskCachePath(cache, key) };
+    std::ifstream ifs{ path, std::ios::binary };
+    std::vector<unsigned char> data{ std::istreambuf_iterator<char>{ ifs }, std::istreambuf_iterator<char>{} };
+
+    auto dst{ vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src0, core) };
+    float* planes[3]{};
+    for (auto plane{ 0 }; plane < 3; plane++)
+        planes[plane] = reinterpret_cast<float*>(vsapi->getWritePtr(dst, plane));
+
+    if (!ifs.is_open() || data.size() < sizeof(entry) || std::memcmp(data.data(), &entry, sizeof(entry)) != 0 ||
+        !decompressFrame(data.data() + sizeof(entry), data.size() - sizeof(entry), planes, d->vi.width, d->vi.height,
+                         vsapi->getStride(dst, 0) / d->vi.format.bytesPerSample)) {
+        // removed, written by another version or for other inputs with the same name, it is interpolated and stored again
+        std::lock_guard<std::mutex> guard{ cache->lock };
+        diskCacheErase(cache, key);
+        vsapi->freeFrame(dst);
+        return nullptr;
+    }
+
+    // the modification time orders the files for eviction in later runs too
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+    std::lock_guard<std::mutex> guard{ cache->lock };
+    if (auto it{ cache->index.find(key) }; it != cache->index.end())
+        cache->files.splice(cache->files.end(), cache->files, it->second);
+    return dst;
+}
+
+static void diskCacheStore(const DiskCacheEntry& entry, const VSFrame* frame, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+    auto cache{ d->diskCache.get() };
+    const auto key{ diskCacheKey(entry) };
+
+    const float* planes[3]{};
+    for (auto plane{ 0 }; plane < 3; plane++)
+        planes[plane] = reinterpret_cast<const float*>(vsapi->getReadPtr(frame, plane));
+    const auto data{ compressFrame(planes, d->vi.width, d->vi.height, vsapi->getStride(frame, 0) / d->vi.format.bytesPerSample) };
+    const auto size{ sizeof(entry) + data.size() };
+
+    if (cache->capacity && size > cache->capacity)
+        return;
+
+    // written under a name of its own and renamed, so that other threads and processes never read a partial file
+    const auto path{ diskCachePath(cache, key) };
+    const auto temp{ path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." +
+                     std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp" };
+
+    auto written{ false };
+    {
+        std::ofstream ofs{ temp, std::ios::binary };
+        ofs.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        written = ofs.write(reinterpret_cast<const char*>(data.data()), data.size()).good();
+    }
+
+    std::error_code ec;
+    if (written)
+        std::filesystem::rename(temp, path, ec);
+
+    if (!written || ec) {
+        std::filesystem::remove(temp, ec);
+        if (!cache->writeFailed.exchange(true))
+            std::cerr << "RIFE: failed to write to disk_cache " << cache->dir << ", frames are interpolated without it" << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard{ cache->lock };
+
+    // another thread may have stored the same frame meanwhile
+    diskCacheErase(cache, key);
+    diskCacheEvict(cache, size);
+    cache->index.emplace(key, cache->files.emplace(cache->files.end(), key, size));
+    cache->size += size;
+}
+
+// union of the active areas of both frames, grown to a multiple of the model padding where the frame allows it
+// so that the networks do not pad it again with zeros
+static Rect letterboxArea(const float* const planes0[3], const float* const planes1[3], const RIFEData* const VS_RESTRICT d,
+                          const ptrdiff_t stride) noexcept {
+    auto area0{ activeArea(planes0, d->vi.width, d->vi.height, stride, d->letterboxThreshold) };
+    auto area1{ activeArea(planes1, d->vi.width, d->vi.height, stride, d->letterboxThreshold) };
+
+    if (area0.width == 0)
+        area0 = area1;
+    if (area1.width == 0)
+        area1 = area0;
+    if (area0.width == 0)
+        return area0;
+
+    const auto x0{ std::min(area0.x, area1.x) };
+    const auto y0{ std::min(area0.y, area1.y) };
+    const auto x1{ std::max(area0.x + area0.width, area1.x + area1.width) };
+    const auto y1{ std::max(area0.y + area0.height, area1.y + area1.height) };
+
+    const auto width{ std::min((x1 - x0 + d->padding - 1) / d->padding * d->padding, d->vi.width) };
+    const auto height{ std::min((y1 - y0 + d->padding - 1) / d->padding * d->padding, d->vi.height) };
+
+    return { std::clamp(x0 - (width - (x1 - x0)) / 2, 0, d->vi.width - width),
+             std::clamp(y0 - (height - (y1 - y0)) / 2, 0, d->vi.height - height),
+             width, height };
 }
 
-static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* instanceData, [[maybe_unused]] void** frameData,
+// PSNR of the interpolated frame against the same interpolation done in fp32, on the same regions as filter()
+// outside of them both are a copy of src0 and add nothing to the error
+static double precisionCheck(const VSFrame* src0, const VSFrame* src1, const VSFrame* dst, const float timestep,
+                             const std::vector<DirtyRegion>& regions, const RIFEData* const VS_RESTRICT d, const VSAPI* vsapi) noexcept {
+    const auto width{ vsapi->getFrameWidth(src0, 0) };
+    const auto height{ vsapi->getFrameHeight(src0, 0) };
+    const auto stride{ vsapi->getStride(src0, 0) / d->vi.format.bytesPerSample };
+
+    std::vector<DirtyRegion> rects{ regions };
+    if (rects.empty())
+        rects.push_back({ { 0, 0, width, height }, { 0, 0, width, height } });
+
+    std::vector<float> ref;
+    auto sse{ 0.0 };
+
+    for (auto&& r : rects) {
+        const auto offset{ r.outer.y * stride + r.outer.x };
+        const auto planeSize{ static_cast<size_t>(stride) * r.outer.height };
+        ref.resize(planeSize * 3);
+
+        d->semaphore->acquire();
+        d->reference->process(reinterpret_cast<const float*>(vsapi->getReadPtr(src0, 0)) + offset,
+                              reinterpret_cast<const float*>(vsapi->getReadPtr(src0, 1)) + offset,
+                              reinterpret_cast<const float*>(vsapi->getReadPtr(src0, 2)) + offset,
+                              reinterpret_cast<const float*>(vsapi->getReadPtr(src1, 0)) + offset,
+                              reinterpret_cast<const float*>(vsapi->getReadPtr(src1, 1)) + offset,
+                              reinterpret_cast<const float*>(vsapi->getReadPtr(src1, 2)) + offset,
+                              ref.data(), ref.data() + planeSize, ref.data() + planeSize * 2, r.outer.width, r.outer.height, stride, timestep);
+        d->semaphore->release();
+
+        for (auto plane{ 0 }; plane < 3; plane++) {
+            auto dstp{ reinterpret_cast<const float*>(vsapi->getReadPtr(dst, plane)) + r.inner.y * stride + r.inner.x };
+            auto refp{ ref.data() + planeSize * plane + (r.inner.y - r.outer.y) * stride + (r.inner.x - r.outer.x) };
+
+            for (auto y{ 0 }; y < r.inner.height; y++) {
+                for (auto x{ 0 }; x < r.inner.width; x++) {
+                    const auto diff{ static_cast<double>(dstp[x]) - refp[x] };
+                    sse += diff * diff;
+                }
+
+                dstp += stride;
+                refp += stride;
+            }
+        }
+    }
+
+    const auto mse{ sse / (3.0 * width * height) };
+    const auto psnr{ mse > 0.0 ? std::min(10.0 * std::log10(1.0 / mse), 100.0) : 100.0 };
+
+    {
+        std::lock_guard<std::mutex> guard{ d->precisionStats->lock };
+        d->precisionStats->sum += psnr;
+        d->precisionStats->min = std::min(d->precisionStats->min, psnr);
+        d->precisionStats->frames++;
+    }
+
+    return psnr;
+}
+
+// run synthetic frames through every worker so that allocator growth, pipeline creation and
+// driver shader compilation are paid for before the first real frame
+static void warmup(const RIFEData* const VS_RESTRICT d, const int frames, const int threads) {
+    const auto width{ d->vi.width };
+    const auto height{ d->vi.height };
+    const auto planeSize{ static_cast<size_t>(width) * height };
+
+    std::vector<float> src(planeSize * 2);
+    for (size_t i{ 0 }; i < src.size(); i++)
+        src[i] = static_cast<float>(i % 256) / 255.0f;
+
+    const auto start{ std::chrono::steady_clock::now() };
+
+    std::vector<std::thread> workers;
+    for (auto t{ 0 }; t < threads; t++) {
+        workers.emplace_back([&] {
+            std::vector<float> dst(planeSize * 3);
+            const auto src0{ src.data() };
+            const auto src1{ src.data() + planeSize };
+
+            for (auto i{ 0 }; i < frames; i++)
+                d->rife->process(src0, src0, src0, src1, src1, src1, dst.data(), dst.data() + planeSize, dst.data() + planeSize * 2,
+                                 width, height, width, 0.5f);
+        });
+    }
+
+    for (auto&& worker : workers)
+        worker.join();
+
+    const auto elapsed{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() };
+    std::cerr << "RIFE: warm-up of " << frames << " frame(s) on " << threads << " thread(s) took " << elapsed << " ms" << std::endl;
+}
+
+static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* instanceData, void** frameData,
                                          VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi) {
     auto d{ static_cast<const RIFEData*>(instanceData) };
 
@@ -80,17 +824,46 @@ static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* inst
     auto remainder{ n * d->factorDen % d->factorNum };
 
     if (activationReason == arInitial) {
+        const auto requested{ d->trace ? ncnn::get_current_time() : 0.0 };
+
+        if (d->frameCache) {
+            if (auto frame{ cacheLookup(n, d, vsapi) }) {
+                if (d->stats) {
+                    std::lock_guard<std::mutex> guard{ d->stats->lock };
+                    d->stats->cached++;
+                }
+
+                if (d->trace) {
+                    std::vector<TraceEvent> events{ { "request", n, std::this_thread::get_id(), requested, ncnn::get_current_time() } };
+                    traceAdd(d, events);
+                }
+
+                return frame;
+            }
+        }
+
+        if (d->trace)
+            *frameData = new double{ requested };
+
         vsapi->requestFrameFilter(frameNum, d->node, frameCtx);
         if (remainder != 0 && n < d->vi.numFrames - d->factor)
             vsapi->requestFrameFilter(frameNum + 1, d->node, frameCtx);
 
-        if (d->skip)
-            vsapi->requestFrameFilter(frameNum, d->psnr, frameCtx);
     } else if (activationReason == arAllFramesReady) {
         auto src0{ vsapi->getFrameFilter(frameNum, d->node, frameCtx) };
         decltype(src0) src1{};
-        decltype(src0) psnr{};
         VSFrame* dst{};
+        double precisionPSNR{ -1.0 };
+        int bypass{ -1 };
+        bool interpolated{};
+        double dirtyArea{ -1.0 };
+        Rect letterboxRect{ -1, -1, -1, -1 };
+        RIFEProfile profile{};
+        std::vector<RIFESpan> spans;
+        std::vector<TraceEvent> events;
+        auto waitMs{ -1.0 };
+        auto frameMs{ -1.0 };
+        auto outcome{ &Stats::source };
 
         if (remainder != 0 && n < d->vi.numFrames - d->factor) {
             bool sceneChange{};
@@ -100,23 +873,150 @@ static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* inst
             if (d->sceneChange)
                 sceneChange = !!vsapi->mapGetInt(vsapi->getFramePropertiesRO(src0), "_SceneChangeNext", 0, &err);
 
-            if (d->skip) {
-                psnr = vsapi->getFrameFilter(frameNum, d->psnr, frameCtx);
-                psnrY = vsapi->mapGetFloat(vsapi->getFramePropertiesRO(psnr), "psnr_y", 0, nullptr);
+            src1 = vsapi->getFrameFilter(frameNum + 1, d->node, frameCtx);
+
+            const auto stride{ vsapi->getStride(src0, 0) / d->vi.format.bytesPerSample };
+            const float* planes0[3]{};
+            const float* planes1[3]{};
+            for (auto plane{ 0 }; plane < 3; plane++) {
+                planes0[plane] = reinterpret_cast<const float*>(vsapi->getReadPtr(src0, plane));
+                planes1[plane] = reinterpret_cast<const float*>(vsapi->getReadPtr(src1, plane));
+            }
+
+            if (d->bypass && !sceneChange)
+                bypass = bypassDecision(frameNum, planes0, planes1, d, stride);
+
+            if (d->skip && !sceneChange && bypass <= 0)
+                psnrY = framePSNR(planes0, planes1, d->vi.width, d->vi.height, stride);
+
+            std::vector<DirtyRegion> regions;
+            if (d->dirty && !sceneChange && bypass <= 0 && psnrY < d->skipThreshold) {
+                regions = dirtyRegions(planes0, planes1, d->vi.width, d->vi.height, stride, d->dirtyThreshold, d->dirtyMargin);
+
+                auto area{ 0.0 };
+                for (auto&& r : regions)
+                    area += static_cast<double>(r.outer.width) * r.outer.height;
+                dirtyArea = area / (static_cast<double>(d->vi.width) * d->vi.height);
+
+                // past half of the frame the regions cost more than they save
+                if (dirtyArea > 0.5) {
+                    regions.clear();
+                    dirtyArea = 1.0;
+                }
             }
 
-            if (sceneChange || psnrY >= d->skipThreshold) {
+            // the borders are static, so there is nothing left to crop once the dirty regions are known
+            if (d->letterbox && !sceneChange && bypass <= 0 && psnrY < d->skipThreshold && regions.empty() && dirtyArea != 0.0) {
+                letterboxRect = letterboxArea(planes0, planes1, d, stride);
+
+                if (letterboxRect.width > 0 && letterboxRect.width * letterboxRect.height < d->vi.width * d->vi.height)
+                    regions.push_back({ letterboxRect, letterboxRect });
+            }
+
+            // the same pair of frames at the same timestep, in this clip or in an earlier run
+            DiskCacheEntry diskEntry{};
+            if (d->diskCache)
+                diskEntry = diskCacheEntry(frameNum, planes0, planes1, static_cast<float>(remainder) / d->factorNum, d, stride);
+
+            if (sceneChange || bypass == 1 || psnrY >= d->skipThreshold || dirtyArea == 0.0 || letterboxRect.width == 0) {
                 dst = vsapi->copyFrame(src0, core);
+                outcome = sceneChange ? &Stats::sceneChange : bypass == 1 ? &Stats::bypassed :
+                          psnrY >= d->skipThreshold ? &Stats::skipped : &Stats::unchanged;
+            } else if (bypass == 2) {
+                dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src0, core);
+                blend(planes0, planes1, dst, static_cast<float>(remainder) / d->factorNum, d, vsapi);
+                interpolated = true;
+                outcome = &Stats::blended;
+            } else if (d->diskCache && (dst = diskCacheLoad(diskEntry, src0, d, core, vsapi))) {
+                interpolated = true;
+                outcome = &Stats::diskCached;
             } else {
-                src1 = vsapi->getFrameFilter(frameNum + 1, d->node, frameCtx);
                 dst = vsapi->newVideoFrame(&d->vi.format, d->vi.width, d->vi.height, src0, core);
-                filter(src0, src1, dst, static_cast<float>(remainder) / d->factorNum, d, vsapi);
+                if (d->profile || d->stats)
+                    waitMs = 0.0;
+
+                // a trace alone leaves the gpu stages as they are, so that the timeline is the one of a normal run
+                profile.serialize = d->profile;
+                if (d->trace)
+                    profile.spans = &spans;
+
+                const auto start{ ncnn::get_current_time() };
+                const auto ret{ filter(src0, src1, dst, static_cast<float>(remainder) / d->factorNum, regions,
+                                       d->profile || d->stats || d->trace ? &profile : nullptr, waitMs >= 0.0 ? &waitMs : nullptr,
+                                       d->trace ? &events : nullptr, d, vsapi) };
+                const auto end{ ncnn::get_current_time() };
+                frameMs = end - start;
+
+                if (d->trace) {
+                    events.push_back({ "interpolate", -1, std::this_thread::get_id(), start, end });
+                    for (auto&& span : spans)
+                        events.push_back({ stageName(span.stage), -1, std::this_thread::get_id(), span.start, span.end });
+                }
+
+                if (ret == RIFE_SCENE_CHANGE) {
+                    vsapi->freeFrame(dst);
+                    dst = vsapi->copyFrame(src0, core);
+                    outcome = &Stats::sceneChange;
+                } else {
+                    interpolated = true;
+                    outcome = &Stats::interpolated;
+                    if (d->diskCache)
+                        diskCacheStore(diskEntry, dst, d, vsapi);
+                    if (d->reference)
+                        precisionPSNR = precisionCheck(src0, src1, dst, static_cast<float>(remainder) / d->factorNum, regions, d, vsapi);
+                }
             }
         } else {
             dst = vsapi->copyFrame(src0, core);
         }
 
         auto props{ vsapi->getFramePropertiesRW(dst) };
+        if (bypass >= 0)
+            vsapi->mapSetInt(props, "RIFE_Bypass", bypass, maReplace);
+
+        if (letterboxRect.width >= 0) {
+            const int64_t area[]{ letterboxRect.x, letterboxRect.y, letterboxRect.width, letterboxRect.height };
+            vsapi->mapSetIntArray(props, "RIFE_ActiveArea", area, 4);
+        }
+
+        if (dirtyArea >= 0.0)
+            vsapi->mapSetFloat(props, "RIFE_DirtyArea", dirtyArea, maReplace);
+
+        if (precisionPSNR >= 0.0)
+            vsapi->mapSetFloat(props, "RIFE_PrecisionPSNR", precisionPSNR, maReplace);
+
+        if (d->profile && waitMs >= 0.0) {
+            vsapi->mapSetFloat(props, "RIFE_ConvertMs", profile.convert, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_UploadMs", profile.upload, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_SceneChangeMs", profile.scene_change, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_PreprocMs", profile.preproc, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_FlownetMs", profile.flownet, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_ContextnetMs", profile.contextnet, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_FusionnetMs", profile.fusionnet, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_PostprocMs", profile.postproc, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_DownloadMs", profile.download, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_WaitMs", waitMs, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_BlobPeakMB", profile.blob_peak / 1048576.0, maReplace);
+            vsapi->mapSetFloat(props, "RIFE_StagingPeakMB", profile.staging_peak / 1048576.0, maReplace);
+        }
+
+        if (d->stats) {
+            std::lock_guard<std::mutex> guard{ d->stats->lock };
+            (d->stats.get()->*outcome)++;
+
+            if (frameMs >= 0.0) {
+                histogramAdd(d->stats->frame, frameMs);
+                histogramAdd(d->stats->wait, waitMs);
+                d->stats->blobPeak = std::max(d->stats->blobPeak, profile.blob_peak);
+                d->stats->stagingPeak = std::max(d->stats->stagingPeak, profile.staging_peak);
+
+                if (d->profile) {
+                    for (size_t i{ 0 }; i < std::size(profileStages); i++)
+                        histogramAdd(d->stats->stages[i], profile.*profileStages[i].second);
+                }
+            }
+        }
+
         int errNum, errDen;
         auto durationNum{ vsapi->mapGetInt(props, "_DurationNum", 0, &errNum) };
         auto durationDen{ vsapi->mapGetInt(props, "_DurationDen", 0, &errDen) };
@@ -126,10 +1026,25 @@ static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* inst
             vsapi->mapSetInt(props, "_DurationDen", durationDen, maReplace);
         }
 
+        // copies of source frames are cheap to produce again
+        if (d->frameCache && interpolated)
+            cacheInsert(n, dst, d, vsapi);
+
+        if (d->trace) {
+            const auto requested{ static_cast<double*>(*frameData) };
+            events.push_back({ "request", n, std::this_thread::get_id(), *requested, ncnn::get_current_time() });
+            delete requested;
+
+            for (auto&& e : events)
+                e.frame = n;
+            traceAdd(d, events);
+        }
+
         vsapi->freeFrame(src0);
         vsapi->freeFrame(src1);
-        vsapi->freeFrame(psnr);
         return dst;
+    } else if (activationReason == arError) {
+        delete static_cast<double*>(*frameData);
     }
 
     return nullptr;
@@ -138,7 +1053,22 @@ static const VSFrame* VS_CC rifeGetFrame(int n, int activationReason, void* inst
 static void VS_CC rifeFree(void* instanceData, [[maybe_unused]] VSCore* core, const VSAPI* vsapi) {
     auto d{ static_cast<RIFEData*>(instanceData) };
     vsapi->freeNode(d->node);
-    vsapi->freeNode(d->psnr);
+
+    if (d->frameCache) {
+        for (auto&& entry : d->frameCache->frames)
+            vsapi->freeFrame(entry.second);
+    }
+
+    if (d->stats)
+        writeStats(d->stats.get(), d->rife->memory());
+
+    if (d->trace)
+        writeTrace(d->trace.get());
+
+    if (d->precisionStats && d->precisionStats->frames > 0)
+        std::cerr << "RIFE: precision check over " << d->precisionStats->frames << " frame(s), average PSNR "
+                  << d->precisionStats->sum / d->precisionStats->frames << " dB, minimum " << d->precisionStats->min << " dB" << std::endl;
+
     delete d;
 
     if (--numGPUInstances == 0)
@@ -194,15 +1124,84 @@ static void VS_CC rifeCreate(const VSMap* in, VSMap* out, [[maybe_unused]] void*
         if (err)
             gpuThread = 2;
 
-        auto tta{ !!vsapi->mapGetInt(in, "tta", 0, &err) };
+        auto tta{ vsapi->mapGetIntSaturated(in, "tta", 0, &err) };
         auto uhd{ !!vsapi->mapGetInt(in, "uhd", 0, &err) };
+
+        auto scale{ vsapi->mapGetFloat(in, "scale", 0, &err) };
+        auto scaleSet{ !err };
+        if (err)
+            scale = 1.0;
+
+        if (scale != 0.25 && scale != 0.5 && scale != 1.0 && scale != 2.0)
+            throw "scale must be 0.25, 0.5, 1.0 or 2.0";
+
         d->sceneChange = !!vsapi->mapGetInt(in, "sc", 0, &err);
+
+        auto scGPU{ !!vsapi->mapGetInt(in, "sc_gpu", 0, &err) };
+
+        auto scThreshold{ vsapi->mapGetFloat(in, "sc_threshold", 0, &err) };
+        if (err)
+            scThreshold = 0.1;
         d->skip = !!vsapi->mapGetInt(in, "skip", 0, &err);
 
         d->skipThreshold = vsapi->mapGetFloat(in, "skip_threshold", 0, &err);
         if (err)
             d->skipThreshold = 60.0;
 
+        d->bypass = !!vsapi->mapGetInt(in, "bypass", 0, &err);
+
+        auto bypassThreshold{ vsapi->mapGetFloat(in, "bypass_threshold", 0, &err) };
+        if (err)
+            bypassThreshold = 2.0 / 255.0;
+
+        d->dirty = !!vsapi->mapGetInt(in, "dirty", 0, &err);
+
+        auto dirtyThreshold{ vsapi->mapGetFloat(in, "dirty_threshold", 0, &err) };
+        if (err)
+            dirtyThreshold = 0.01;
+
+        d->dirtyMargin = vsapi->mapGetIntSaturated(in, "dirty_margin", 0, &err);
+        if (err)
+            d->dirtyMargin = 64;
+
+        d->letterbox = !!vsapi->mapGetInt(in, "letterbox", 0, &err);
+
+        auto letterboxThreshold{ vsapi->mapGetFloat(in, "letterbox_threshold", 0, &err) };
+        if (err)
+            letterboxThreshold = 0.03;
+
+        auto cacheSize{ vsapi->mapGetInt(in, "cache_size", 0, &err) };
+
+        auto disk_cache{ vsapi->mapGetData(in, "disk_cache", 0, &err) };
+        std::string diskCacheDir{ err ? "" : disk_cache };
+
+        auto diskCacheSize{ vsapi->mapGetInt(in, "disk_cache_size", 0, &err) };
+
+        auto warmupFrames{ vsapi->mapGetIntSaturated(in, "warmup", 0, &err) };
+
+        // flownet, contextnet, fusionnet, missing values repeat the last one
+        int precision[3]{ RIFE_PRECISION_FP16_STORAGE, RIFE_PRECISION_FP16_STORAGE, RIFE_PRECISION_FP16_STORAGE };
+        auto numPrecision{ vsapi->mapNumElements(in, "precision") };
+        if (numPrecision > 3)
+            throw "precision can have at most 3 values";
+
+        for (auto i{ 0 }; i < 3 && numPrecision > 0; i++) {
+            precision[i] = vsapi->mapGetIntSaturated(in, "precision", std::min(i, numPrecision - 1), nullptr);
+
+            if (precision[i] < RIFE_PRECISION_FP32 || precision[i] > RIFE_PRECISION_FP16_ARITHMETIC)
+                throw "precision must be 0, 1 or 2";
+        }
+
+        auto checkPrecision{ !!vsapi->mapGetInt(in, "precision_check", 0, &err) };
+
+        d->profile = !!vsapi->mapGetInt(in, "profile", 0, &err);
+
+        auto stats_path{ vsapi->mapGetData(in, "stats", 0, &err) };
+        std::string statsPath{ err ? "" : stats_path };
+
+        auto trace_path{ vsapi->mapGetData(in, "trace_path", 0, &err) };
+        std::string tracePath{ err ? "" : trace_path };
+
         if (model < 0 || model > 76)
             throw "model must be between 0 and 76 (inclusive)";
 
@@ -225,9 +1224,49 @@ static void VS_CC rifeCreate(const VSMap* in, VSMap* out, [[maybe_unused]] void*
             throw "gpu_thread must be greater than 0";
 
         
+        if (tta != 0 && tta != 1 && tta != 2 && tta != 4 && tta != 8)
+            throw "tta must be 0, 1, 2, 4 or 8";
+
         if (d->skipThreshold < 0 || d->skipThreshold > 60)
             throw "skip_threshold must be between 0.0 and 60.0 (inclusive)";
 
+        if (scThreshold <= 0 || scThreshold > 1)
+            throw "sc_threshold must be greater than 0.0 and less than or equal to 1.0";
+
+        if (bypassThreshold < 0 || bypassThreshold > 1)
+            throw "bypass_threshold must be between 0.0 and 1.0 (inclusive)";
+
+        if (dirtyThreshold < 0 || dirtyThreshold > 1)
+            throw "dirty_threshold must be between 0.0 and 1.0 (inclusive)";
+
+        if (d->dirtyMargin < 0)
+            throw "dirty_margin must be at least 0";
+
+        if (letterboxThreshold < 0 || letterboxThreshold > 1)
+            throw "letterbox_threshold must be between 0.0 and 1.0 (inclusive)";
+
+        if (cacheSize < 0)
+            throw "cache_size must be at least 0";
+
+        if (diskCacheSize < 0)
+            throw "disk_cache_size must be at least 0";
+
+        if (warmupFrames < 0)
+            throw "warmup must be at least 0";
+
+        if (!diskCacheDir.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(diskCacheDir, ec);
+            if (!std::filesystem::is_directory(diskCacheDir, ec))
+                throw "failed to create disk_cache directory";
+        }
+
+        if (!statsPath.empty() && !std::ofstream{ statsPath }.is_open())
+            throw "failed to open stats file";
+
+        if (!tracePath.empty() && !std::ofstream{ tracePath }.is_open())
+            throw "failed to open trace file";
+
         if (fpsNum && fpsDen) {
             vsh::muldivRational(&fpsNum, &fpsDen, d->vi.fpsDen, d->vi.fpsNum);
             d->factorNum = fpsNum;
@@ -244,7 +1283,6 @@ static void VS_CC rifeCreate(const VSMap* in, VSMap* out, [[maybe_unused]] void*
         if (d->vi.numFrames / d->factorDen > INT_MAX / d->factorNum)
             throw "resulting clip is too long";
 
-        auto oldNumFrames{ d->vi.numFrames };
         d->vi.numFrames = static_cast<int>(d->vi.numFrames * d->factorNum / d->factorDen);
 
         d->factor = d->factorNum / d->factorDen;
@@ -516,7 +1554,9 @@ static void VS_CC rifeCreate(const VSMap* in, VSMap* out, [[maybe_unused]] void*
             }
         }
 
-        std::ifstream ifs{ modelPath + "/flownet.param" };
+        std::ifstream ifs{ modelPath + "/rife.pack" };
+        if (!ifs.is_open())
+            ifs.open(modelPath + "/flownet.param");
         if (!ifs.is_open())
             throw "failed to load model";
         ifs.close();
@@ -551,111 +1591,131 @@ static void VS_CC rifeCreate(const VSMap* in, VSMap* out, [[maybe_unused]] void*
         if (rife_v4 && tta)
             throw "rife-v4 model does not support TTA mode";
 
-        d->semaphore = std::make_unique<std::counting_semaphore<>>(gpuThread);
-
-        if (d->skip) {
-            auto vmaf{ vsapi->getPluginByID("com.holywu.vmaf", core) };
-
-            if (!vmaf)
-                throw "VMAF plugin is required when skip=True";
+        // uhd is the same as halving the flow resolution
+        if (uhd) {
+            if (!scaleSet)
+                scale = 0.5;
+            uhd = false;
+        }
 
-            auto args{ vsapi->createMap() };
-            vsapi->mapConsumeNode(args, "clip", d->node, maReplace);
-            vsapi->mapSetInt(args, "width", std::min(d->vi.width, 512), maReplace);
-            vsapi->mapSetInt(args, "height", std::min(d->vi.height, 512), maReplace);
-            vsapi->mapSetInt(args, "format", pfYUV420P8, maReplace);
-            vsapi->mapSetData(args, "matrix_s", "709", -1, dtUtf8, maReplace);
+        // the coarsest pyramid level, or the resized frames of v1-v3 models, must still divide the padded frame
+        if (scale < 1.0)
+            padding = static_cast<int>(padding / scale);
 
-            auto ret{ vsapi->invoke(vsapi->getPluginByID(VSH_RESIZE_PLUGIN_ID, core), "Bicubic", args) };
-            if (vsapi->mapGetError(ret)) {
-                vsapi->mapSetError(out, vsapi->mapGetError(ret));
-                vsapi->freeMap(args);
-                vsapi->freeMap(ret);
+        d->semaphore = std::make_unique<std::counting_semaphore<>>(gpuThread);
 
-                if (--numGPUInstances == 0)
-                    ncnn::destroy_gpu_instance();
-                return;
-            }
+        d->letterboxThreshold = static_cast<float>(letterboxThreshold);
+        d->padding = padding;
 
-            vsapi->clearMap(args);
-            auto reference{ vsapi->mapGetNode(ret, "clip", 0, nullptr) };
-            vsapi->mapSetNode(args, "clip", reference, maReplace);
-            vsapi->mapSetInt(args, "frames", oldNumFrames - 1, maReplace);
+        if (cacheSize > 0) {
+            d->frameCache = std::make_unique<FrameCache>();
+            d->frameCache->size = 0;
+            d->frameCache->capacity = static_cast<size_t>(cacheSize) * 1024 * 1024;
+        }
 
-            vsapi->freeMap(ret);
-            ret = vsapi->invoke(vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core), "DuplicateFrames", args);
-            if (vsapi->mapGetError(ret)) {
-                vsapi->mapSetError(out, vsapi->mapGetError(ret));
-                vsapi->freeMap(args);
-                vsapi->freeMap(ret);
+        d->bypassThreshold = static_cast<float>(bypassThreshold);
+        d->dirtyThreshold = static_cast<float>(dirtyThreshold);
+        if (d->bypass || !diskCacheDir.empty()) {
+            d->hashCache = std::make_unique<HashCache>();
+            std::fill_n(d->hashCache->frame, 16, -1);
+        }
 
-                if (--numGPUInstances == 0)
-                    ncnn::destroy_gpu_instance();
-                return;
+        if (!diskCacheDir.empty()) {
+            d->diskCache = std::make_unique<DiskCache>();
+            d->diskCache->dir = diskCacheDir;
+
+            d->diskCache->size = 0;
+            d->diskCache->capacity = static_cast<uintmax_t>(diskCacheSize) * 1024 * 1024;
+
+            // the files of earlier runs, least recently used first
+            std::vector<std::tuple<std::filesystem::file_time_type, uint64_t, uintmax_t>> files;
+            std::error_code ec;
+            for (auto it{ std::filesystem::directory_iterator{ diskCacheDir, ec } }; !ec && it != std::filesystem::directory_iterator{};
+                 it.increment(ec)) {
+                const auto name{ it->path().filename().string() };
+                std::error_code fileEc;
+                const auto time{ it->last_write_time(fileEc) };
+                const auto size{ it->file_size(fileEc) };
+                if (name.size() == 21 && name.ends_with(".rifc") && !fileEc)
+                    files.emplace_back(time, std::strtoull(name.c_str(), nullptr, 16), size);
             }
+            std::sort(files.begin(), files.end());
 
-            vsapi->clearMap(args);
-            vsapi->mapConsumeNode(args, "clip", vsapi->mapGetNode(ret, "clip", 0, nullptr), maReplace);
-            vsapi->mapSetInt(args, "first", 1, maReplace);
-
-            vsapi->freeMap(ret);
-            ret = vsapi->invoke(vsapi->getPluginByID(VSH_STD_PLUGIN_ID, core), "Trim", args);
-            if (vsapi->mapGetError(ret)) {
-                vsapi->mapSetError(out, vsapi->mapGetError(ret));
-                vsapi->freeMap(args);
-                vsapi->freeMap(ret);
-
-                if (--numGPUInstances == 0)
-                    ncnn::destroy_gpu_instance();
-                return;
+            for (auto&& [time, key, size] : files) {
+                d->diskCache->index.emplace(key, d->diskCache->files.emplace(d->diskCache->files.end(), key, size));
+                d->diskCache->size += size;
             }
+            diskCacheEvict(d->diskCache.get(), 0);
+        }
 
-            vsapi->clearMap(args);
-            vsapi->mapConsumeNode(args, "reference", reference, maReplace);
-            vsapi->mapConsumeNode(args, "distorted", vsapi->mapGetNode(ret, "clip", 0, nullptr), maReplace);
-            vsapi->mapSetInt(args, "feature", 0, maReplace);
+        if (!statsPath.empty()) {
+            d->stats = std::make_unique<Stats>();
+            d->stats->path = statsPath;
+            d->stats->gpuThread = gpuThread;
+        }
 
-            vsapi->freeMap(ret);
-            ret = vsapi->invoke(vmaf, "Metric", args);
-            if (vsapi->mapGetError(ret)) {
-                vsapi->mapSetError(out, vsapi->mapGetError(ret));
-                vsapi->freeMap(args);
-                vsapi->freeMap(ret);
+        if (!tracePath.empty()) {
+            d->trace = std::make_unique<Trace>();
+            d->trace->path = tracePath;
+            d->trace->start = ncnn::get_current_time();
+        }
 
-                if (--numGPUInstances == 0)
-                    ncnn::destroy_gpu_instance();
-                return;
-            }
 
-            d->psnr = vsapi->mapGetNode(ret, "clip", 0, nullptr);
-            vsapi->freeMap(args);
-            vsapi->freeMap(ret);
+        d->rife = std::make_unique<RIFE>(gpuId, tta, uhd, 1, rife_v2, rife_v4, padding, static_cast<float>(scale));
+        d->rife->set_precision(precision[0], precision[1], precision[2]);
+        if (scGPU) {
+            d->rife->set_scene_change_threshold(static_cast<float>(scThreshold));
+            d->scThreshold = static_cast<float>(scThreshold);
         }
 
-        d->rife = std::make_unique<RIFE>(gpuId, tta, uhd, 1, rife_v2, rife_v4, padding);
+        if (checkPrecision) {
+            d->reference = std::make_unique<RIFE>(gpuId, tta, uhd, 1, rife_v2, rife_v4, padding, static_cast<float>(scale));
+            d->reference->set_precision(RIFE_PRECISION_FP32, RIFE_PRECISION_FP32, RIFE_PRECISION_FP32);
+            d->precisionStats = std::make_unique<PrecisionStats>();
+            d->precisionStats->sum = 0.0;
+            d->precisionStats->min = 100.0;
+            d->precisionStats->frames = 0;
+        }
 
 #ifdef _WIN32
         auto bufferSize{ MultiByteToWideChar(CP_UTF8, 0, modelPath.c_str(), -1, nullptr, 0) };
         std::vector<wchar_t> wbuffer(bufferSize);
         MultiByteToWideChar(CP_UTF8, 0, modelPath.c_str(), -1, wbuffer.data(), bufferSize);
-        d->rife->load(wbuffer.data());
+        if (d->rife->load(wbuffer.data()) != 0 || (d->reference && d->reference->load(wbuffer.data()) != 0))
 #else
-        d->rife->load(modelPath);
+        if (d->rife->load(modelPath) != 0 || (d->reference && d->reference->load(modelPath) != 0))
 #endif
+            throw "failed to load model";
+
+        if (d->diskCache) {
+            // anything that changes the interpolated frame, the frames and the timestep are added per frame
+            // the precision is the one the device allows, and the weights are told apart by the files they were loaded from
+            int effective[3];
+            d->rife->get_precision(effective[0], effective[1], effective[2]);
+            const auto& gpuInfo{ ncnn::get_gpu_info(gpuId) };
+            const auto settings{ modelPath + "|" + weightFiles(modelPath) + "|" + std::to_string(d->vi.width) + "x" + std::to_string(d->vi.height) +
+                                 "|gpu " + gpuInfo.device_name() + " " + std::to_string(gpuInfo.driver_version()) +
+                                 "|precision " + std::to_string(effective[0]) + std::to_string(effective[1]) + std::to_string(effective[2]) +
+                                 "|tta " + std::to_string(tta) + "|scale " + std::to_string(scale) + "|padding " + std::to_string(padding) +
+                                 "|sc_gpu " + std::to_string(scGPU ? scThreshold : 0.0) +
+                                 "|dirty " + (d->dirty ? std::to_string(dirtyThreshold) + " " + std::to_string(d->dirtyMargin) : "off") +
+                                 "|letterbox " + (d->letterbox ? std::to_string(letterboxThreshold) : "off") };
+            d->diskCache->salt = stringHash(settings);
+        }
+
+        if (warmupFrames > 0)
+            warmup(d.get(), warmupFrames, gpuThread);
     } catch (const char* error) {
         vsapi->mapSetError(out, ("RIFE: "s + error).c_str());
         vsapi->freeNode(d->node);
-        vsapi->freeNode(d->psnr);
 
         if (--numGPUInstances == 0)
             ncnn::destroy_gpu_instance();
         return;
     }
 
-    std::vector<VSFilterDependency> deps{ {d->node, rpGeneral} };
-    if (d->skip)
-        deps.push_back({ d->psnr, rpGeneral });
-    vsapi->createVideoFilter(out, "RIFE", &d->vi, rifeGetFrame, rifeFree, fmParallel, deps.data(), deps.size(), d.get(), core);
+    VSFilterDependency deps[]{ {d->node, rpGeneral} };
+    vsapi->createVideoFilter(out, "RIFE", &d->vi, rifeGetFrame, rifeFree, fmParallel, deps, 1, d.get(), core);
     d.release();
 }
 
@@ -678,10 +1738,29 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin* plugin, const VSPLUGINAPI
                              "gpu_thread:int:opt;"
                              "tta:int:opt;"
                              "uhd:int:opt;"
+                             "scale:float:opt;"
                              "sc:int:opt;"
+                             "sc_gpu:int:opt;"
+                             "sc_threshold:float:opt;"
                              "skip:int:opt;"
                              "skip_threshold:float:opt;"
-                             "list_gpu:int:opt;",
+                             "bypass:int:opt;"
+                             "bypass_threshold:float:opt;"
+                             "dirty:int:opt;"
+                             "dirty_threshold:float:opt;"
+                             "dirty_margin:int:opt;"
+                             "letterbox:int:opt;"
+                             "letterbox_threshold:float:opt;"
+                             "list_gpu:int:opt;"
+                             "cache_size:int:opt;"
+                             "disk_cache:data:opt;"
+                             "disk_cache_size:int:opt;"
+                             "warmup:int:opt;"
+                             "precision:int[]:opt;"
+                             "precision_check:int:opt;"
+                             "profile:int:opt;"
+                             "stats:data:opt;"
+                             "trace_path:data:opt;",
                              "clip:vnode;",
                              rifeCreate, nullptr, plugin);
 }
@@ -4,6 +4,9 @@
 //#include <iostream>
 
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <string.h>
 #include <vector>
 #include "benchmark.h"
 
@@ -11,38 +14,59 @@
 #include "rife_postproc.comp.hex.h"
 #include "rife_preproc_tta.comp.hex.h"
 #include "rife_postproc_tta.comp.hex.h"
+#include "rife_flow_tta_sum.comp.hex.h"
+#include "rife_v2_flow_tta_sum.comp.hex.h"
 #include "rife_flow_tta_avg.comp.hex.h"
 #include "rife_v2_flow_tta_avg.comp.hex.h"
 #include "rife_flow_tta_temporal_avg.comp.hex.h"
 #include "rife_v2_flow_tta_temporal_avg.comp.hex.h"
 #include "rife_out_tta_temporal_avg.comp.hex.h"
-#include "rife_v4_timestep.comp.hex.h"
+#include "rife_out_tta_sum.comp.hex.h"
+#include "rife_sc_blocks.comp.hex.h"
 
 #include "rife_ops.h"
+#include "param_graph.h"
 
 DEFINE_LAYER_CREATOR(Warp)
+DEFINE_LAYER_CREATOR(Warp2)
 
-RIFE::RIFE(int gpuid, bool _tta_mode, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4, int _padding)
+RIFE::RIFE(int gpuid, int _tta_mode, bool _uhd_mode, int _num_threads, bool _rife_v2, bool _rife_v4, int _padding, float _scale)
 {
     vkdev = gpuid == -1 ? 0 : ncnn::get_gpu_device(gpuid);
 
     rife_preproc = 0;
     rife_postproc = 0;
+    rife_flow_tta_sum = 0;
     rife_flow_tta_avg = 0;
     rife_flow_tta_temporal_avg = 0;
     rife_out_tta_temporal_avg = 0;
-    rife_v4_timestep = 0;
+    rife_out_tta_sum = 0;
+    rife_sc_blocks = 0;
     rife_uhd_downscale_image = 0;
     rife_uhd_upscale_flow = 0;
-    rife_uhd_double_flow = 0;
+    rife_uhd_scale_flow = 0;
     rife_v2_slice_flow = 0;
-    tta_mode = _tta_mode;
+    // number of flipped/transposed variants, 1 keeps the meaning of the former boolean
+    tta_mode = _tta_mode == 1 ? 8 : _tta_mode;
     tta_temporal_mode = false;
-    uhd_mode = _uhd_mode;
     num_threads = _num_threads;
     rife_v2 = _rife_v2;
     rife_v4 = _rife_v4;
     padding = _padding;
+    scale = _scale;
+
+    // v1-v3 estimate the flow on frames resized by scale, uhd is the same as a scale of 0.5
+    // v4 rescales its own flow pyramid instead, see load()
+    if (!rife_v4 && _uhd_mode && scale == 1.f)
+        scale = 0.5f;
+    uhd_mode = !rife_v4 && scale != 1.f;
+    precision[0] = RIFE_PRECISION_FP16_STORAGE;
+    precision[1] = RIFE_PRECISION_FP16_STORAGE;
+    precision[2] = RIFE_PRECISION_FP16_STORAGE;
+    sc_threshold = 0.f;
+    weight_memory[0] = 0;
+    weight_memory[1] = 0;
+    weight_memory[2] = 0;
 }
 
 RIFE::~RIFE()
@@ -51,10 +75,12 @@ RIFE::~RIFE()
     {
         delete rife_preproc;
         delete rife_postproc;
+        delete rife_flow_tta_sum;
         delete rife_flow_tta_avg;
         delete rife_flow_tta_temporal_avg;
         delete rife_out_tta_temporal_avg;
-        delete rife_v4_timestep;
+        delete rife_out_tta_sum;
+        delete rife_sc_blocks;
     }
 
     if (uhd_mode)
@@ -65,8 +91,8 @@ RIFE::~RIFE()
         rife_uhd_upscale_flow->destroy_pipeline(flownet.opt);
         delete rife_uhd_upscale_flow;
 
-        rife_uhd_double_flow->destroy_pipeline(flownet.opt);
-        delete rife_uhd_double_flow;
+        rife_uhd_scale_flow->destroy_pipeline(flownet.opt);
+        delete rife_uhd_scale_flow;
     }
 
     if (rife_v2)
@@ -76,50 +102,278 @@ RIFE::~RIFE()
     }
 }
 
+// load a param with the warp pairs fused and, for the flownet of v4 models, the flow pyramid rescaled and the timestep input
+// turned into a single value, see fuse_warp_pairs, rescale_flownet and broadcast_timestep
+static int load_param_edited(ncnn::Net& net, const char* param, bool v4_flownet, float scale)
+{
+    ParamGraph graph;
+    if (graph.parse(param) != 0)
+    {
+        fprintf(stderr, "invalid param\n");
+        return -1;
+    }
+
+    if (v4_flownet && scale != 1.f && rescale_flownet(graph, scale) != 0)
+    {
+        fprintf(stderr, "flownet pyramid not recognized, scale %f is not supported by this model\n", scale);
+        return -1;
+    }
+
+    if (v4_flownet && broadcast_timestep(graph, "in2", "in0") != 0)
+    {
+        fprintf(stderr, "flownet timestep input not recognized\n");
+        return -1;
+    }
+
+    fuse_warp_pairs(graph);
+
+    return net.load_param_mem(graph.str().c_str());
+}
+
+static int load_param_edited(ncnn::Net& net, FILE* fp, bool v4_flownet, float scale)
+{
+    std::string param;
+    char buf[4096];
+    size_t nread;
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        param.append(buf, nread);
+    }
+
+    return load_param_edited(net, param.c_str(), v4_flownet, scale);
+}
+
+// forwards to another reader and counts the weight values read, a weight blob is read as a 4-byte flag and then its data,
+// fp16 data is tagged with 0x01306B47 and anything else is counted as fp32
+class DataReaderCounter : public ncnn::DataReader
+{
+public:
+    explicit DataReaderCounter(const ncnn::DataReader& _dr) : elements(0), dr(_dr), fp16_next(false) {}
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        size_t nread = dr.read(buf, size);
+
+        uint32_t tag = 0;
+        if (nread == 4)
+            memcpy(&tag, buf, 4);
+
+        if (tag == 0x01306B47)
+            fp16_next = true;
+        else
+            count(nread);
+
+        return nread;
+    }
+
+    virtual size_t reference(size_t size, const void** buf) const
+    {
+        size_t nread = dr.reference(size, buf);
+        count(nread);
+        return nread;
+    }
+
+public:
+    mutable size_t elements;
+
+private:
+    void count(size_t nread) const
+    {
+        elements += fp16_next ? nread / 2 : nread / 4;
+        fp16_next = false;
+    }
+
+    const ncnn::DataReader& dr;
+    mutable bool fp16_next;
+};
+
+// the weights are uploaded at the storage precision of the net, weight_bytes is what they take on the device,
+// without the padding of packed layouts and the blocks of the weight allocator
+static int load_model_counted(ncnn::Net& net, const ncnn::DataReader& dr, size_t& weight_bytes)
+{
+    DataReaderCounter counter(dr);
+    int ret = net.load_model(counter);
+
+    weight_bytes = counter.elements * (net.opt.use_fp16_storage ? 2 : 4);
+
+    return ret;
+}
+
 #if _WIN32
-static void load_param_model(ncnn::Net& net, const std::wstring& modeldir, const wchar_t* name)
+static int load_param_model(ncnn::Net& net, const std::wstring& modeldir, const wchar_t* name, size_t& weight_bytes, bool v4_flownet = false, float scale = 1.f)
 {
     wchar_t parampath[256];
     wchar_t modelpath[256];
     swprintf(parampath, 256, L"%s/%s.param", modeldir.c_str(), name);
     swprintf(modelpath, 256, L"%s/%s.bin", modeldir.c_str(), name);
 
+    int ret = 0;
     {
         FILE* fp = _wfopen(parampath, L"rb");
         if (!fp)
         {
             fwprintf(stderr, L"_wfopen %ls failed\n", parampath);
+            return -1;
         }
 
-        net.load_param(fp);
+        ret = load_param_edited(net, fp, v4_flownet, scale);
 
         fclose(fp);
+
+        if (ret != 0)
+            return ret;
     }
     {
         FILE* fp = _wfopen(modelpath, L"rb");
         if (!fp)
         {
             fwprintf(stderr, L"_wfopen %ls failed\n", modelpath);
+            return -1;
         }
 
-        net.load_model(fp);
+        {
+            ncnn::DataReaderFromStdio dr(fp);
+            ret = load_model_counted(net, dr, weight_bytes);
+        }
 
         fclose(fp);
     }
+
+    return ret;
 }
 #else
-static void load_param_model(ncnn::Net& net, const std::string& modeldir, const char* name)
+static int load_param_model(ncnn::Net& net, const std::string& modeldir, const char* name, size_t& weight_bytes, bool v4_flownet = false, float scale = 1.f)
 {
     char parampath[256];
     char modelpath[256];
     sprintf(parampath, "%s/%s.param", modeldir.c_str(), name);
     sprintf(modelpath, "%s/%s.bin", modeldir.c_str(), name);
 
-    net.load_param(parampath);
-    net.load_model(modelpath);
+    int ret = 0;
+    {
+        FILE* fp = fopen(parampath, "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", parampath);
+            return -1;
+        }
+
+        ret = load_param_edited(net, fp, v4_flownet, scale);
+
+        fclose(fp);
+
+        if (ret != 0)
+            return ret;
+    }
+
+    {
+        FILE* fp = fopen(modelpath, "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", modelpath);
+            return -1;
+        }
+
+        {
+            ncnn::DataReaderFromStdio dr(fp);
+            ret = load_model_counted(net, dr, weight_bytes);
+        }
+
+        fclose(fp);
+    }
+
+    return ret;
 }
 #endif
 
+#if _WIN32
+static int load_model_pack(ModelPack& pack, const std::wstring& modeldir)
+{
+    wchar_t packpath[256];
+    swprintf(packpath, 256, L"%s/%s", modeldir.c_str(), L"" MODEL_PACK_NAME);
+
+    FILE* fp = _wfopen(packpath, L"rb");
+#else
+static int load_model_pack(ModelPack& pack, const std::string& modeldir)
+{
+    char packpath[256];
+    sprintf(packpath, "%s/%s", modeldir.c_str(), MODEL_PACK_NAME);
+
+    FILE* fp = fopen(packpath, "rb");
+#endif
+    if (!fp)
+        return -1;
+
+    int ret = pack.load(fp);
+    if (ret != 0)
+    {
+        fprintf(stderr, "invalid %s, loading param and bin instead\n", MODEL_PACK_NAME);
+    }
+    else if (strcmp(pack.ncnn_version(), NCNN_VERSION_STRING) != 0)
+    {
+        // the weight format is stable across versions, this only tells where a pack came from
+        fprintf(stderr, "%s was built with ncnn %s, loading with %s\n", MODEL_PACK_NAME, pack.ncnn_version(), NCNN_VERSION_STRING);
+    }
+
+    fclose(fp);
+
+    return ret;
+}
+
+void RIFE::set_precision(int flownet_precision, int contextnet_precision, int fusionnet_precision)
+{
+    precision[0] = flownet_precision;
+    precision[1] = contextnet_precision;
+    precision[2] = fusionnet_precision;
+}
+
+void RIFE::set_scene_change_threshold(float threshold)
+{
+    sc_threshold = threshold;
+}
+
+static void set_precision_option(ncnn::Option& opt, const ncnn::VulkanDevice* vkdev, int precision)
+{
+    opt.use_fp16_packed = vkdev && precision != RIFE_PRECISION_FP32;
+    opt.use_fp16_storage = vkdev && precision != RIFE_PRECISION_FP32;
+    opt.use_fp16_arithmetic = vkdev && precision == RIFE_PRECISION_FP16_ARITHMETIC;
+
+    if (opt.use_fp16_arithmetic && !vkdev->info.support_fp16_arithmetic())
+    {
+        fprintf(stderr, "fp16 arithmetic is not supported by this device, using fp16 storage\n");
+        opt.use_fp16_arithmetic = false;
+    }
+}
+
+static int option_precision(const ncnn::Option& opt)
+{
+    if (opt.use_fp16_arithmetic)
+        return RIFE_PRECISION_FP16_ARITHMETIC;
+    if (opt.use_fp16_storage)
+        return RIFE_PRECISION_FP16_STORAGE;
+    return RIFE_PRECISION_FP32;
+}
+
+void RIFE::get_precision(int& flownet_precision, int& contextnet_precision, int& fusionnet_precision) const
+{
+    flownet_precision = option_precision(flownet.opt);
+    contextnet_precision = option_precision(contextnet.opt);
+    fusionnet_precision = option_precision(fusionnet.opt);
+}
+
+// whether every layer of net runs on the gpu, whose weights are uploaded and dropped from host memory while loading
+static bool runs_on_gpu(const ncnn::Net& net)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (!layers[i]->support_vulkan)
+            return false;
+    }
+
+    return true;
+}
+
 #if _WIN32
 int RIFE::load(const std::wstring& modeldir)
 #else
@@ -129,15 +383,20 @@ int RIFE::load(const std::string& modeldir)
     ncnn::Option opt;
     opt.num_threads = num_threads;
     opt.use_vulkan_compute = vkdev ? true : false;
-    opt.use_fp16_packed = vkdev ? true : false;
-    opt.use_fp16_storage = vkdev ? true : false;
-    opt.use_fp16_arithmetic = false;
     opt.use_int8_storage = false;
 
     flownet.opt = opt;
     contextnet.opt = opt;
     fusionnet.opt = opt;
 
+    set_precision_option(flownet.opt, vkdev, precision[0]);
+    set_precision_option(contextnet.opt, vkdev, precision[1]);
+    set_precision_option(fusionnet.opt, vkdev, precision[2]);
+
+    bool fp32_weights = !flownet.opt.use_fp16_storage;
+    if (!rife_v4)
+        fp32_weights = fp32_weights || !contextnet.opt.use_fp16_storage || !fusionnet.opt.use_fp16_storage;
+
     flownet.set_vulkan_device(vkdev);
     contextnet.set_vulkan_device(vkdev);
     fusionnet.set_vulkan_device(vkdev);
@@ -145,22 +404,96 @@ int RIFE::load(const std::string& modeldir)
     flownet.register_custom_layer("rife.Warp", Warp_layer_creator);
     contextnet.register_custom_layer("rife.Warp", Warp_layer_creator);
     fusionnet.register_custom_layer("rife.Warp", Warp_layer_creator);
+    flownet.register_custom_layer("rife.Warp2", Warp2_layer_creator);
+    contextnet.register_custom_layer("rife.Warp2", Warp2_layer_creator);
+    fusionnet.register_custom_layer("rife.Warp2", Warp2_layer_creator);
 
-#if _WIN32
-    load_param_model(flownet, modeldir, L"flownet");
-    if (!rife_v4)
+    // the single-file pack is preferred, unless its weights were reduced to fp16 and fp16 storage is not in use
+    bool use_pack = load_model_pack(pack, modeldir) == 0;
+    if (use_pack && (pack.flags() & MODEL_PACK_FP16_STORAGE) && fp32_weights)
     {
-        load_param_model(contextnet, modeldir, L"contextnet");
-        load_param_model(fusionnet, modeldir, L"fusionnet");
+        fprintf(stderr, "%s holds fp16 weights, loading param and bin instead\n", MODEL_PACK_NAME);
+        use_pack = false;
     }
-#else
-    load_param_model(flownet, modeldir, "flownet");
-    if (!rife_v4)
+    if (use_pack && (!pack.has("flownet") || (!rife_v4 && (!pack.has("contextnet") || !pack.has("fusionnet")))))
     {
-        load_param_model(contextnet, modeldir, "contextnet");
-        load_param_model(fusionnet, modeldir, "fusionnet");
+        fprintf(stderr, "%s is missing a network, loading param and bin instead\n", MODEL_PACK_NAME);
+        use_pack = false;
     }
+    if (!use_pack)
+    {
+        pack = ModelPack();
+    }
+
+    // the flow pyramid of v4 models is rescaled in the flownet param itself
+    const float flownet_scale = rife_v4 ? scale : 1.f;
+
+    if (use_pack)
+    {
+        {
+            if (load_param_edited(flownet, pack.param("flownet"), rife_v4, flownet_scale) != 0)
+                return -1;
+
+            const unsigned char* mem = pack.model("flownet");
+            ncnn::DataReaderFromMemory dr(mem);
+            if (load_model_counted(flownet, dr, weight_memory[0]) != 0)
+                return -1;
+        }
+        if (!rife_v4)
+        {
+            {
+                if (load_param_edited(contextnet, pack.param("contextnet"), false, 1.f) != 0)
+                    return -1;
+
+                const unsigned char* mem = pack.model("contextnet");
+                ncnn::DataReaderFromMemory dr(mem);
+                if (load_model_counted(contextnet, dr, weight_memory[1]) != 0)
+                    return -1;
+            }
+            {
+                if (load_param_edited(fusionnet, pack.param("fusionnet"), false, 1.f) != 0)
+                    return -1;
+
+                const unsigned char* mem = pack.model("fusionnet");
+                ncnn::DataReaderFromMemory dr(mem);
+                if (load_model_counted(fusionnet, dr, weight_memory[2]) != 0)
+                    return -1;
+            }
+        }
+
+        // the uploaded weights no longer reference the pack, only fp32 weights of the cpu backend and cpu layers still use it in place
+        if (vkdev && runs_on_gpu(flownet) && (rife_v4 || (runs_on_gpu(contextnet) && runs_on_gpu(fusionnet))))
+            pack = ModelPack();
+    }
+    else
+    {
+#if _WIN32
+        if (load_param_model(flownet, modeldir, L"flownet", weight_memory[0], rife_v4, flownet_scale) != 0)
+            return -1;
+        if (!rife_v4)
+        {
+            if (load_param_model(contextnet, modeldir, L"contextnet", weight_memory[1]) != 0)
+                return -1;
+            if (load_param_model(fusionnet, modeldir, L"fusionnet", weight_memory[2]) != 0)
+                return -1;
+        }
+#else
+        if (load_param_model(flownet, modeldir, "flownet", weight_memory[0], rife_v4, flownet_scale) != 0)
+            return -1;
+        if (!rife_v4)
+        {
+            if (load_param_model(contextnet, modeldir, "contextnet", weight_memory[1]) != 0)
+                return -1;
+            if (load_param_model(fusionnet, modeldir, "fusionnet", weight_memory[2]) != 0)
+                return -1;
+        }
 #endif
+    }
+
+    // the networks may have dropped fp16 options the device does not support while loading
+    // preprocess works on flownet blobs, postprocess on the blobs of the last network
+    opt = flownet.opt;
+    const ncnn::Option& out_opt = rife_v4 ? flownet.opt : fusionnet.opt;
 
     // initialize preprocess and postprocess pipeline
     if (vkdev)
@@ -199,9 +532,9 @@ int RIFE::load(const std::string& modeldir)
                 if (spirv.empty())
                 {
                     if (tta_mode)
-                        compile_spirv_module(rife_postproc_tta_comp_data, sizeof(rife_postproc_tta_comp_data), opt, spirv);
+                        compile_spirv_module(rife_postproc_tta_comp_data, sizeof(rife_postproc_tta_comp_data), out_opt, spirv);
                     else
-                        compile_spirv_module(rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, spirv);
+                        compile_spirv_module(rife_postproc_comp_data, sizeof(rife_postproc_comp_data), out_opt, spirv);
                 }
             }
 
@@ -211,6 +544,32 @@ int RIFE::load(const std::string& modeldir)
         }
     }
 
+    if (vkdev && tta_mode)
+    {
+        std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
+        {
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
+            {
+                if (rife_v2)
+                {
+                    compile_spirv_module(rife_v2_flow_tta_sum_comp_data, sizeof(rife_v2_flow_tta_sum_comp_data), opt, spirv);
+                }
+                else
+                {
+                    compile_spirv_module(rife_flow_tta_sum_comp_data, sizeof(rife_flow_tta_sum_comp_data), opt, spirv);
+                }
+            }
+        }
+
+        std::vector<ncnn::vk_specialization_type> specializations(0);
+
+        rife_flow_tta_sum = new ncnn::Pipeline(vkdev);
+        rife_flow_tta_sum->set_optimal_local_size_xyz(8, 8, 1);
+        rife_flow_tta_sum->create(spirv.data(), spirv.size() * 4, specializations);
+    }
+
     if (vkdev && tta_mode)
     {
         std::vector<uint32_t> spirv;
@@ -271,7 +630,7 @@ int RIFE::load(const std::string& modeldir)
             ncnn::MutexLockGuard guard(lock);
             if (spirv.empty())
             {
-                compile_spirv_module(rife_out_tta_temporal_avg_comp_data, sizeof(rife_out_tta_temporal_avg_comp_data), opt, spirv);
+                compile_spirv_module(rife_out_tta_temporal_avg_comp_data, sizeof(rife_out_tta_temporal_avg_comp_data), out_opt, spirv);
             }
         }
 
@@ -282,6 +641,25 @@ int RIFE::load(const std::string& modeldir)
         rife_out_tta_temporal_avg->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
+    if (vkdev && tta_mode)
+    {
+        std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
+        {
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
+            {
+                compile_spirv_module(rife_out_tta_sum_comp_data, sizeof(rife_out_tta_sum_comp_data), out_opt, spirv);
+            }
+        }
+
+        std::vector<ncnn::vk_specialization_type> specializations(0);
+
+        rife_out_tta_sum = new ncnn::Pipeline(vkdev);
+        rife_out_tta_sum->set_optimal_local_size_xyz(8, 8, 3);
+        rife_out_tta_sum->create(spirv.data(), spirv.size() * 4, specializations);
+    }
+
     if (uhd_mode)
     {
         {
@@ -290,8 +668,8 @@ int RIFE::load(const std::string& modeldir)
 
             ncnn::ParamDict pd;
             pd.set(0, 2);// bilinear
-            pd.set(1, 0.5f);
-            pd.set(2, 0.5f);
+            pd.set(1, scale);
+            pd.set(2, scale);
             rife_uhd_downscale_image->load_param(pd);
 
             rife_uhd_downscale_image->create_pipeline(opt);
@@ -302,23 +680,23 @@ int RIFE::load(const std::string& modeldir)
 
             ncnn::ParamDict pd;
             pd.set(0, 2);// bilinear
-            pd.set(1, 2.f);
-            pd.set(2, 2.f);
+            pd.set(1, 1.f / scale);
+            pd.set(2, 1.f / scale);
             rife_uhd_upscale_flow->load_param(pd);
 
             rife_uhd_upscale_flow->create_pipeline(opt);
         }
         {
-            rife_uhd_double_flow = ncnn::create_layer("BinaryOp");
-            rife_uhd_double_flow->vkdev = vkdev;
+            rife_uhd_scale_flow = ncnn::create_layer("BinaryOp");
+            rife_uhd_scale_flow->vkdev = vkdev;
 
             ncnn::ParamDict pd;
             pd.set(0, 2);// mul
             pd.set(1, 1);// with_scalar
-            pd.set(2, 2.f);// b
-            rife_uhd_double_flow->load_param(pd);
+            pd.set(2, 1.f / scale);// b
+            rife_uhd_scale_flow->load_param(pd);
 
-            rife_uhd_double_flow->create_pipeline(opt);
+            rife_uhd_scale_flow->create_pipeline(opt);
         }
     }
 
@@ -341,45 +719,331 @@ int RIFE::load(const std::string& modeldir)
         }
     }
 
-    if (rife_v4)
+    if (vkdev && sc_threshold > 0.f)
     {
-        if (vkdev)
+        std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
         {
-            std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    compile_spirv_module(rife_v4_timestep_comp_data, sizeof(rife_v4_timestep_comp_data), opt, spirv);
-                }
+                compile_spirv_module(rife_sc_blocks_comp_data, sizeof(rife_sc_blocks_comp_data), opt, spirv);
             }
+        }
 
-            std::vector<ncnn::vk_specialization_type> specializations;
+        std::vector<ncnn::vk_specialization_type> specializations;
 
-            rife_v4_timestep = new ncnn::Pipeline(vkdev);
-            rife_v4_timestep->set_optimal_local_size_xyz(8, 8, 1);
-            rife_v4_timestep->create(spirv.data(), spirv.size() * 4, specializations);
-        }
+        rife_sc_blocks = new ncnn::Pipeline(vkdev);
+        rife_sc_blocks->set_optimal_local_size_xyz(8, 8, 1);
+        rife_sc_blocks->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
     return 0;
 }
 
+bool RIFE::detect_scene_change(const ncnn::VkMat& in0_gpu, const ncnn::VkMat& in1_gpu, ncnn::VkCompute& cmd, const ncnn::Option& opt) const
+{
+    // the difference of the mean colors of each block of a 16x16 grid over the frame
+    const int grid_w = std::min(in0_gpu.w, 16);
+    const int grid_h = std::min(in0_gpu.h, 16);
+
+    ncnn::VkMat diff_gpu;
+    diff_gpu.create(grid_w, grid_h, 1, sizeof(float), 1, opt.blob_vkallocator);
+
+    {
+        std::vector<ncnn::VkMat> bindings(3);
+        bindings[0] = in0_gpu;
+        bindings[1] = in1_gpu;
+        bindings[2] = diff_gpu;
+
+        std::vector<ncnn::vk_constant_type> constants(5);
+        constants[0].i = in0_gpu.w;
+        constants[1].i = in0_gpu.h;
+        constants[2].i = in0_gpu.cstep;
+        constants[3].i = diff_gpu.w;
+        constants[4].i = diff_gpu.h;
+
+        cmd.record_pipeline(rife_sc_blocks, bindings, constants, diff_gpu);
+    }
+
+    // the networks are only recorded once the result is known
+    ncnn::Mat diff;
+    cmd.record_clone(diff_gpu, diff, opt);
+    cmd.submit_and_wait();
+    cmd.reset();
+
+    // a cut changes the colors all over the frame, while a pan or a moving object leaves most block means as they were
+    // the uploaded frames are in 0..255
+    const float* diffptr = diff;
+    int changed = 0;
+    for (int i = 0; i < grid_w * grid_h; i++)
+    {
+        if (diffptr[i] / 255.f > sc_threshold)
+            changed++;
+    }
+
+    return changed * 2 > grid_w * grid_h;
+}
+
+// blobs passed between networks are converted to the storage precision of the consuming network
+static void input_blob(ncnn::Extractor& ex, const char* name, const ncnn::VkMat& blob, const ncnn::Net& net, ncnn::VkCompute& cmd, const ncnn::Option& opt)
+{
+    if (blob.elembits() == (net.opt.use_fp16_storage ? 16 : 32))
+    {
+        ex.input(name, blob);
+        return;
+    }
+
+    ncnn::Option cast_opt = opt;
+    cast_opt.use_fp16_packed = net.opt.use_fp16_packed;
+    cast_opt.use_fp16_storage = net.opt.use_fp16_storage;
+    cast_opt.use_fp16_arithmetic = net.opt.use_fp16_arithmetic;
+
+    ncnn::VkMat blob_cast;
+    net.vulkan_device()->convert_packing(blob, blob_cast, blob.elempack, cmd, cast_opt);
+    ex.input(name, blob_cast);
+}
+
+// the variants used for a given tta count, 2 is the 180 degree rotation as in the reference implementation
+static int tta_variant(int tta_count, int i)
+{
+    return tta_count == 2 ? i * 2 : i;
+}
+
+// padded copy of in, flipped/transposed for tta variant
+static void record_preproc_tta(const ncnn::Pipeline* pipeline, const ncnn::VkMat& in, ncnn::VkMat& out, int variant, int w_padded, int h_padded, size_t elemsize, ncnn::VkAllocator* allocator, ncnn::VkCompute& cmd)
+{
+    if (variant < 4)
+        out.create(w_padded, h_padded, 3, elemsize, 1, allocator);
+    else
+        out.create(h_padded, w_padded, 3, elemsize, 1, allocator);
+
+    std::vector<ncnn::VkMat> bindings(2);
+    bindings[0] = in;
+    bindings[1] = out;
+
+    std::vector<ncnn::vk_constant_type> constants(7);
+    constants[0].i = in.w;
+    constants[1].i = in.h;
+    constants[2].i = in.cstep;
+    constants[3].i = w_padded;
+    constants[4].i = h_padded;
+    constants[5].i = out.cstep;
+    constants[6].i = variant;
+
+    ncnn::VkMat dispatcher;
+    dispatcher.w = w_padded;
+    dispatcher.h = h_padded;
+    dispatcher.c = 3;
+    cmd.record_pipeline(pipeline, bindings, constants, dispatcher);
+}
+
+// sum += blob of tta variant turned back to the orientation of the input, sum is overwritten when first is set
+static void record_tta_sum(const ncnn::Pipeline* pipeline, const ncnn::VkMat& blob, const ncnn::VkMat& sum, int variant, bool first, int channels, ncnn::VkCompute& cmd)
+{
+    std::vector<ncnn::VkMat> bindings(2);
+    bindings[0] = blob;
+    bindings[1] = sum;
+
+    std::vector<ncnn::vk_constant_type> constants(6);
+    constants[0].i = sum.w;
+    constants[1].i = sum.h;
+    constants[2].i = blob.cstep;
+    constants[3].i = sum.cstep;
+    constants[4].i = variant;
+    constants[5].i = first ? 1 : 0;
+
+    ncnn::VkMat dispatcher;
+    dispatcher.w = sum.w;
+    dispatcher.h = sum.h;
+    dispatcher.c = channels;
+    cmd.record_pipeline(pipeline, bindings, constants, dispatcher);
+}
+
+struct MemoryCounter
+{
+    std::atomic<size_t> current;
+    std::atomic<size_t> peak;
+};
+
+struct DeviceMemory
+{
+    MemoryCounter blob;
+    MemoryCounter staging;
+};
+
+// the counters of every device in use, map nodes stay where they are as devices are added
+static DeviceMemory& device_memory(const ncnn::VulkanDevice* vkdev)
+{
+    static std::map<const ncnn::VulkanDevice*, DeviceMemory> devices;
+    static ncnn::Mutex lock;
+
+    ncnn::MutexLockGuard guard(lock);
+    return devices[vkdev];
+}
+
+// forwards to the allocator acquired by process and counts the bytes it holds, for the call and for the device,
+// the peak of the call is stored in peak_out when it is gone, after every mat allocated from it
+class CountingVkAllocator : public ncnn::VkAllocator
+{
+public:
+    CountingVkAllocator(ncnn::VkAllocator* _allocator, MemoryCounter& _device, size_t* _peak_out)
+        : ncnn::VkAllocator(_allocator->vkdev), allocator(_allocator), device(_device), peak_out(_peak_out), current(0), peak(0)
+    {
+        buffer_memory_type_index = allocator->buffer_memory_type_index;
+        image_memory_type_index = allocator->image_memory_type_index;
+        reserved_type_index = allocator->reserved_type_index;
+        mappable = allocator->mappable;
+        coherent = allocator->coherent;
+    }
+
+    virtual ~CountingVkAllocator()
+    {
+        if (peak_out)
+            *peak_out = std::max(*peak_out, peak);
+    }
+
+    virtual ncnn::VkBufferMemory* fastMalloc(size_t size)
+    {
+        ncnn::VkBufferMemory* ptr = allocator->fastMalloc(size);
+        if (!ptr)
+            return 0;
+
+        current += ptr->capacity;
+        peak = std::max(peak, current);
+
+        size_t device_current = device.current.fetch_add(ptr->capacity) + ptr->capacity;
+        size_t device_peak = device.peak.load();
+        while (device_peak < device_current && !device.peak.compare_exchange_weak(device_peak, device_current))
+        {
+        }
+
+        return ptr;
+    }
+
+    virtual void fastFree(ncnn::VkBufferMemory* ptr)
+    {
+        current -= ptr->capacity;
+        device.current -= ptr->capacity;
+
+        allocator->fastFree(ptr);
+    }
+
+    virtual int flush(ncnn::VkBufferMemory* ptr)
+    {
+        return allocator->flush(ptr);
+    }
+
+    virtual int invalidate(ncnn::VkBufferMemory* ptr)
+    {
+        return allocator->invalidate(ptr);
+    }
+
+public:
+    ncnn::VkAllocator* allocator;
+
+private:
+    MemoryCounter& device;
+    size_t* peak_out;
+    size_t current;
+    size_t peak;
+};
+
+RIFEMemory RIFE::memory() const
+{
+    RIFEMemory memory = {};
+    if (!vkdev)
+        return memory;
+
+    DeviceMemory& device = device_memory(vkdev);
+    memory.blob = device.blob.current;
+    memory.blob_peak = device.blob.peak;
+    memory.staging = device.staging.current;
+    memory.staging_peak = device.staging.peak;
+    memory.flownet = weight_memory[0];
+    memory.contextnet = weight_memory[1];
+    memory.fusionnet = weight_memory[2];
+    return memory;
+}
+
+// measures the stages of process when a profile is given, with serialize the commands recorded for a stage
+// are submitted and waited for so that its time does not overlap with the next one
+class StageTimer
+{
+public:
+    StageTimer(RIFEProfile* _profile) : profile(_profile), last(_profile ? ncnn::get_current_time() : 0.0)
+    {
+    }
+
+    // host work, or gpu work that has already been waited for
+    void host(double RIFEProfile::*stage)
+    {
+        if (!profile)
+            return;
+
+        double now = ncnn::get_current_time();
+        profile->*stage += now - last;
+        if (profile->spans)
+            profile->spans->push_back({stage, last, now});
+        last = now;
+    }
+
+    void gpu(double RIFEProfile::*stage, ncnn::VkCompute& cmd)
+    {
+        if (!profile)
+            return;
+
+        if (!profile->serialize)
+        {
+            host(&RIFEProfile::record);
+            return;
+        }
+
+        cmd.submit_and_wait();
+        cmd.reset();
+        host(stage);
+    }
+
+    // submits the remaining commands and waits for them, which is all the gpu work without serialize
+    void wait(double RIFEProfile::*stage, ncnn::VkCompute& cmd)
+    {
+        if (profile && !profile->serialize)
+            host(&RIFEProfile::record);
+
+        cmd.submit_and_wait();
+
+        if (profile)
+            host(profile->serialize ? stage : &RIFEProfile::gpu);
+    }
+
+private:
+    RIFEProfile* profile;
+    double last;
+};
+
 int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                   const float* src1R, const float* src1G, const float* src1B,
                   float* dstR, float* dstG, float* dstB,
-                  const int w, const int h, const ptrdiff_t stride, const float timestep) const
+                  const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile, bool scene_change) const
 {
+    if (!vkdev)
+        return process_cpu(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, w, h, stride, timestep, profile);
+
     if (rife_v4)
-        return process_v4(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, w, h, stride, timestep);
+        return process_v4(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, w, h, stride, timestep, profile, scene_change);
+
+    StageTimer timer(profile);
 
     const int channels = 3;//in0image.elempack;
 
 //     fprintf(stderr, "%d x %d\n", w, h);
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    // declared first so that they outlive every mat allocated from them
+    CountingVkAllocator blob_counter(vkdev->acquire_blob_allocator(), device_memory(vkdev).blob, profile ? &profile->blob_peak : 0);
+    CountingVkAllocator staging_counter(vkdev->acquire_staging_allocator(), device_memory(vkdev).staging, profile ? &profile->staging_peak : 0);
+
+    ncnn::VkAllocator* blob_vkallocator = &blob_counter;
+    ncnn::VkAllocator* staging_vkallocator = &staging_counter;
 
     ncnn::Option opt = flownet.opt;
     opt.blob_vkallocator = blob_vkallocator;
@@ -413,6 +1077,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
         }
     }
 
+    timer.host(&RIFEProfile::convert);
+
     ncnn::VkCompute cmd(vkdev);
 
     // upload
@@ -423,235 +1089,195 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
         cmd.record_clone(in1, in1_gpu, opt);
     }
 
+    timer.gpu(&RIFEProfile::upload, cmd);
+
+    if (scene_change && rife_sc_blocks && detect_scene_change(in0_gpu, in1_gpu, cmd, opt))
+    {
+        timer.host(&RIFEProfile::scene_change);
+
+        vkdev->reclaim_blob_allocator(blob_counter.allocator);
+        vkdev->reclaim_staging_allocator(staging_counter.allocator);
+
+        return RIFE_SCENE_CHANGE;
+    }
+
+    timer.host(&RIFEProfile::scene_change);
+
     ncnn::VkMat out_gpu;
 
     if (tta_mode)
     {
-        // preproc
-        ncnn::VkMat in0_gpu_padded[8];
-        ncnn::VkMat in1_gpu_padded[8];
+        // the variants are processed one at a time and only their sums are kept, in the orientation of the input
+        // a first pass averages the flow over all variants, a second one runs contextnet and fusionnet on each of them
+        const int tta_count = tta_mode;
+        const int directions = tta_temporal_mode ? 2 : 1;
+
+        // flow and flow_reversed sums
+        ncnn::VkMat flow_sum[2];
+        int flow_c = 0;
+        size_t flow_elemsize = 0;
+        int flow_elempack = 0;
+
+        for (int i = 0; i < tta_count; i++)
         {
-            in0_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in0_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = in0_gpu;
-            bindings[1] = in0_gpu_padded[0];
-            bindings[2] = in0_gpu_padded[1];
-            bindings[3] = in0_gpu_padded[2];
-            bindings[4] = in0_gpu_padded[3];
-            bindings[5] = in0_gpu_padded[4];
-            bindings[6] = in0_gpu_padded[5];
-            bindings[7] = in0_gpu_padded[6];
-            bindings[8] = in0_gpu_padded[7];
+            const int ti = tta_variant(tta_count, i);
 
-            std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = in0_gpu.w;
-            constants[1].i = in0_gpu.h;
-            constants[2].i = in0_gpu.cstep;
-            constants[3].i = in0_gpu_padded[0].w;
-            constants[4].i = in0_gpu_padded[0].h;
-            constants[5].i = in0_gpu_padded[0].cstep;
+            // preproc
+            ncnn::VkMat in0_gpu_padded;
+            ncnn::VkMat in1_gpu_padded;
+            record_preproc_tta(rife_preproc, in0_gpu, in0_gpu_padded, ti, w_padded, h_padded, in_out_tile_elemsize, blob_vkallocator, cmd);
+            record_preproc_tta(rife_preproc, in1_gpu, in1_gpu_padded, ti, w_padded, h_padded, in_out_tile_elemsize, blob_vkallocator, cmd);
 
-            cmd.record_pipeline(rife_preproc, bindings, constants, in0_gpu_padded[0]);
-        }
-        {
-            in1_gpu_padded[0].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[1].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[2].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[3].create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[4].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[5].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[6].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-            in1_gpu_padded[7].create(h_padded, w_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = in1_gpu;
-            bindings[1] = in1_gpu_padded[0];
-            bindings[2] = in1_gpu_padded[1];
-            bindings[3] = in1_gpu_padded[2];
-            bindings[4] = in1_gpu_padded[3];
-            bindings[5] = in1_gpu_padded[4];
-            bindings[6] = in1_gpu_padded[5];
-            bindings[7] = in1_gpu_padded[6];
-            bindings[8] = in1_gpu_padded[7];
+            timer.gpu(&RIFEProfile::preproc, cmd);
 
-            std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = in1_gpu.w;
-            constants[1].i = in1_gpu.h;
-            constants[2].i = in1_gpu.cstep;
-            constants[3].i = in1_gpu_padded[0].w;
-            constants[4].i = in1_gpu_padded[0].h;
-            constants[5].i = in1_gpu_padded[0].cstep;
+            for (int di = 0; di < directions; di++)
+            {
+                const ncnn::VkMat& flow_in0 = di == 0 ? in0_gpu_padded : in1_gpu_padded;
+                const ncnn::VkMat& flow_in1 = di == 0 ? in1_gpu_padded : in0_gpu_padded;
 
-            cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded[0]);
-        }
+                // flownet
+                ncnn::VkMat flow;
+                {
+                    ncnn::Extractor ex = flownet.create_extractor();
+                    ex.set_blob_vkallocator(blob_vkallocator);
+                    ex.set_workspace_vkallocator(blob_vkallocator);
+                    ex.set_staging_vkallocator(staging_vkallocator);
 
-        ncnn::VkMat flow[8];
-        for (int ti = 0; ti < 8; ti++)
-        {
-            // flownet
-            ncnn::Extractor ex = flownet.create_extractor();
-            ex.set_blob_vkallocator(blob_vkallocator);
-            ex.set_workspace_vkallocator(blob_vkallocator);
-            ex.set_staging_vkallocator(staging_vkallocator);
+                    if (uhd_mode)
+                    {
+                        ncnn::VkMat in0_gpu_padded_downscaled;
+                        ncnn::VkMat in1_gpu_padded_downscaled;
+                        rife_uhd_downscale_image->forward(flow_in0, in0_gpu_padded_downscaled, cmd, opt);
+                        rife_uhd_downscale_image->forward(flow_in1, in1_gpu_padded_downscaled, cmd, opt);
 
-            if (uhd_mode)
-            {
-                ncnn::VkMat in0_gpu_padded_downscaled;
-                ncnn::VkMat in1_gpu_padded_downscaled;
-                rife_uhd_downscale_image->forward(in0_gpu_padded[ti], in0_gpu_padded_downscaled, cmd, opt);
-                rife_uhd_downscale_image->forward(in1_gpu_padded[ti], in1_gpu_padded_downscaled, cmd, opt);
+                        ex.input("input0", in0_gpu_padded_downscaled);
+                        ex.input("input1", in1_gpu_padded_downscaled);
 
-                ex.input("input0", in0_gpu_padded_downscaled);
-                ex.input("input1", in1_gpu_padded_downscaled);
+                        ncnn::VkMat flow_downscaled;
+                        ex.extract("flow", flow_downscaled, cmd);
+
+                        ncnn::VkMat flow_upscaled;
+                        rife_uhd_upscale_flow->forward(flow_downscaled, flow_upscaled, cmd, opt);
+
+                        rife_uhd_scale_flow->forward(flow_upscaled, flow, cmd, opt);
+                    }
+                    else
+                    {
+                        ex.input("input0", flow_in0);
+                        ex.input("input1", flow_in1);
+                        ex.extract("flow", flow, cmd);
+                    }
+                }
+
+                // the first variant is never flipped, its shape is the one of the sum
+                if (i == 0)
+                {
+                    flow_c = flow.c;
+                    flow_elemsize = flow.elemsize;
+                    flow_elempack = flow.elempack;
+
+                    if (rife_v2)
+                        flow_sum[di].create(flow.w, flow.h, 1, (size_t)16u, 4, blob_vkallocator);
+                    else
+                        flow_sum[di].create(flow.w, flow.h, 2, (size_t)4u, 1, blob_vkallocator);
+                }
+
+                record_tta_sum(rife_flow_tta_sum, flow, flow_sum[di], ti, i == 0, 1, cmd);
+            }
+
+            timer.gpu(&RIFEProfile::flownet, cmd);
+        }
+
+        ncnn::VkMat out_sum;
+        out_sum.create(w_padded, h_padded, 3, (size_t)4u, 1, blob_vkallocator);
+
+        for (int i = 0; i < tta_count; i++)
+        {
+            const int ti = tta_variant(tta_count, i);
+            const bool last = i == tta_count - 1;
 
-                ncnn::VkMat flow_downscaled;
-                ex.extract("flow", flow_downscaled, cmd);
+            // preproc
+            ncnn::VkMat in0_gpu_padded;
+            ncnn::VkMat in1_gpu_padded;
+            record_preproc_tta(rife_preproc, in0_gpu, in0_gpu_padded, ti, w_padded, h_padded, in_out_tile_elemsize, blob_vkallocator, cmd);
+            record_preproc_tta(rife_preproc, in1_gpu, in1_gpu_padded, ti, w_padded, h_padded, in_out_tile_elemsize, blob_vkallocator, cmd);
 
-                ncnn::VkMat flow_half;
-                rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
+            timer.gpu(&RIFEProfile::preproc, cmd);
 
-                rife_uhd_double_flow->forward(flow_half, flow[ti], cmd, opt);
-            }
-            else
+            // save some memory
+            if (last)
             {
-                ex.input("input0", in0_gpu_padded[ti]);
-                ex.input("input1", in1_gpu_padded[ti]);
-                ex.extract("flow", flow[ti], cmd);
+                in0_gpu.release();
+                in1_gpu.release();
             }
-        }
 
-        ncnn::VkMat flow_reversed[8];
-        if (tta_temporal_mode)
-        {
-            for (int ti = 0; ti < 8; ti++)
+            // avg flow, as seen by this variant
+            ncnn::VkMat flow[2];
+            for (int di = 0; di < directions; di++)
             {
-                // flownet
-                ncnn::Extractor ex = flownet.create_extractor();
-                ex.set_blob_vkallocator(blob_vkallocator);
-                ex.set_workspace_vkallocator(blob_vkallocator);
-                ex.set_staging_vkallocator(staging_vkallocator);
-
-                if (uhd_mode)
-                {
-                    ncnn::VkMat in0_gpu_padded_downscaled;
-                    ncnn::VkMat in1_gpu_padded_downscaled;
-                    rife_uhd_downscale_image->forward(in0_gpu_padded[ti], in0_gpu_padded_downscaled, cmd, opt);
-                    rife_uhd_downscale_image->forward(in1_gpu_padded[ti], in1_gpu_padded_downscaled, cmd, opt);
+                if (ti < 4)
+                    flow[di].create(flow_sum[di].w, flow_sum[di].h, flow_c, flow_elemsize, flow_elempack, blob_vkallocator);
+                else
+                    flow[di].create(flow_sum[di].h, flow_sum[di].w, flow_c, flow_elemsize, flow_elempack, blob_vkallocator);
 
-                    ex.input("input0", in1_gpu_padded_downscaled);
-                    ex.input("input1", in0_gpu_padded_downscaled);
+                std::vector<ncnn::VkMat> bindings(2);
+                bindings[0] = flow_sum[di];
+                bindings[1] = flow[di];
 
-                    ncnn::VkMat flow_downscaled;
-                    ex.extract("flow", flow_downscaled, cmd);
+                std::vector<ncnn::vk_constant_type> constants(6);
+                constants[0].i = flow_sum[di].w;
+                constants[1].i = flow_sum[di].h;
+                constants[2].i = flow[di].cstep;
+                constants[3].i = flow_sum[di].cstep;
+                constants[4].i = ti;
+                constants[5].i = tta_count;
 
-                    ncnn::VkMat flow_half;
-                    rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
+                ncnn::VkMat dispatcher;
+                dispatcher.w = flow_sum[di].w;
+                dispatcher.h = flow_sum[di].h;
+                dispatcher.c = 1;
+                cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
 
-                    rife_uhd_double_flow->forward(flow_half, flow_reversed[ti], cmd, opt);
-                }
-                else
+                if (last)
                 {
-                    ex.input("input0", in1_gpu_padded[ti]);
-                    ex.input("input1", in0_gpu_padded[ti]);
-                    ex.extract("flow", flow_reversed[ti], cmd);
+                    flow_sum[di].release();
                 }
             }
-        }
-
-        // avg flow
-        ncnn::VkMat flow0[8];
-        ncnn::VkMat flow1[8];
-        {
-            std::vector<ncnn::VkMat> bindings(8);
-            bindings[0] = flow[0];
-            bindings[1] = flow[1];
-            bindings[2] = flow[2];
-            bindings[3] = flow[3];
-            bindings[4] = flow[4];
-            bindings[5] = flow[5];
-            bindings[6] = flow[6];
-            bindings[7] = flow[7];
-
-            std::vector<ncnn::vk_constant_type> constants(3);
-            constants[0].i = flow[0].w;
-            constants[1].i = flow[0].h;
-            constants[2].i = flow[0].cstep;
-
-            ncnn::VkMat dispatcher;
-            dispatcher.w = flow[0].w;
-            dispatcher.h = flow[0].h;
-            dispatcher.c = 1;
-            cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
-        }
-
-        if (tta_temporal_mode)
-        {
-            std::vector<ncnn::VkMat> bindings(8);
-            bindings[0] = flow_reversed[0];
-            bindings[1] = flow_reversed[1];
-            bindings[2] = flow_reversed[2];
-            bindings[3] = flow_reversed[3];
-            bindings[4] = flow_reversed[4];
-            bindings[5] = flow_reversed[5];
-            bindings[6] = flow_reversed[6];
-            bindings[7] = flow_reversed[7];
-
-            std::vector<ncnn::vk_constant_type> constants(3);
-            constants[0].i = flow_reversed[0].w;
-            constants[1].i = flow_reversed[0].h;
-            constants[2].i = flow_reversed[0].cstep;
-
-            ncnn::VkMat dispatcher;
-            dispatcher.w = flow_reversed[0].w;
-            dispatcher.h = flow_reversed[0].h;
-            dispatcher.c = 1;
-            cmd.record_pipeline(rife_flow_tta_avg, bindings, constants, dispatcher);
 
             // merge flow and flow_reversed
-            for (int ti = 0; ti < 8; ti++)
+            if (tta_temporal_mode)
             {
                 std::vector<ncnn::VkMat> bindings(2);
-                bindings[0] = flow[ti];
-                bindings[1] = flow_reversed[ti];
+                bindings[0] = flow[0];
+                bindings[1] = flow[1];
 
                 std::vector<ncnn::vk_constant_type> constants(3);
-                constants[0].i = flow[ti].w;
-                constants[1].i = flow[ti].h;
-                constants[2].i = flow[ti].cstep;
+                constants[0].i = flow[0].w;
+                constants[1].i = flow[0].h;
+                constants[2].i = flow[0].cstep;
 
                 ncnn::VkMat dispatcher;
-                dispatcher.w = flow[ti].w;
-                dispatcher.h = flow[ti].h;
+                dispatcher.w = flow[0].w;
+                dispatcher.h = flow[0].h;
                 dispatcher.c = 1;
 
                 cmd.record_pipeline(rife_flow_tta_temporal_avg, bindings, constants, dispatcher);
             }
-        }
 
-        if (rife_v2)
-        {
-            for (int ti = 0; ti < 8; ti++)
+            ncnn::VkMat flow0;
+            ncnn::VkMat flow1;
+            if (rife_v2)
             {
                 std::vector<ncnn::VkMat> inputs(1);
-                inputs[0] = flow[ti];
+                inputs[0] = flow[0];
                 std::vector<ncnn::VkMat> outputs(2);
                 rife_v2_slice_flow->forward(inputs, outputs, cmd, opt);
-                flow0[ti] = outputs[0];
-                flow1[ti] = outputs[1];
+                flow0 = outputs[0];
+                flow1 = outputs[1];
             }
-        }
 
-        ncnn::VkMat out_gpu_padded[8];
-        for (int ti = 0; ti < 8; ti++)
-        {
+            timer.gpu(&RIFEProfile::flownet, cmd);
+
             // contextnet
             ncnn::VkMat ctx0[4];
             ncnn::VkMat ctx1[4];
@@ -661,14 +1287,14 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ex.set_workspace_vkallocator(blob_vkallocator);
                 ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("input.1", in0_gpu_padded[ti]);
+                input_blob(ex, "input.1", in0_gpu_padded, contextnet, cmd, opt);
                 if (rife_v2)
                 {
-                    ex.input("flow.0", flow0[ti]);
+                    input_blob(ex, "flow.0", flow0, contextnet, cmd, opt);
                 }
                 else
                 {
-                    ex.input("flow.0", flow[ti]);
+                    input_blob(ex, "flow.0", flow[0], contextnet, cmd, opt);
                 }
                 ex.extract("f1", ctx0[0], cmd);
                 ex.extract("f2", ctx0[1], cmd);
@@ -681,14 +1307,14 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ex.set_workspace_vkallocator(blob_vkallocator);
                 ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("input.1", in1_gpu_padded[ti]);
+                input_blob(ex, "input.1", in1_gpu_padded, contextnet, cmd, opt);
                 if (rife_v2)
                 {
-                    ex.input("flow.0", flow1[ti]);
+                    input_blob(ex, "flow.0", flow1, contextnet, cmd, opt);
                 }
                 else
                 {
-                    ex.input("flow.1", flow[ti]);
+                    input_blob(ex, "flow.1", flow[0], contextnet, cmd, opt);
                 }
                 ex.extract("f1", ctx1[0], cmd);
                 ex.extract("f2", ctx1[1], cmd);
@@ -696,53 +1322,29 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ex.extract("f4", ctx1[3], cmd);
             }
 
+            timer.gpu(&RIFEProfile::contextnet, cmd);
+
             // fusionnet
+            ncnn::VkMat out_gpu_padded;
             {
                 ncnn::Extractor ex = fusionnet.create_extractor();
                 ex.set_blob_vkallocator(blob_vkallocator);
                 ex.set_workspace_vkallocator(blob_vkallocator);
                 ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("img0", in0_gpu_padded[ti]);
-                ex.input("img1", in1_gpu_padded[ti]);
-                ex.input("flow", flow[ti]);
-                ex.input("3", ctx0[0]);
-                ex.input("4", ctx0[1]);
-                ex.input("5", ctx0[2]);
-                ex.input("6", ctx0[3]);
-                ex.input("7", ctx1[0]);
-                ex.input("8", ctx1[1]);
-                ex.input("9", ctx1[2]);
-                ex.input("10", ctx1[3]);
-
-                // save some memory
-                if (!tta_temporal_mode)
-                {
-                    if (ti == 0)
-                    {
-                        in0_gpu.release();
-                        in1_gpu.release();
-                    }
-                    else
-                    {
-                        in0_gpu_padded[ti - 1].release();
-                        in1_gpu_padded[ti - 1].release();
-                    }
-                    ctx0[0].release();
-                    ctx0[1].release();
-                    ctx0[2].release();
-                    ctx0[3].release();
-                    ctx1[0].release();
-                    ctx1[1].release();
-                    ctx1[2].release();
-                    ctx1[3].release();
-                }
-                if (ti != 0)
-                {
-                    flow[ti - 1].release();
-                }
-
-                ex.extract("output", out_gpu_padded[ti], cmd);
+                input_blob(ex, "img0", in0_gpu_padded, fusionnet, cmd, opt);
+                input_blob(ex, "img1", in1_gpu_padded, fusionnet, cmd, opt);
+                input_blob(ex, "flow", flow[0], fusionnet, cmd, opt);
+                input_blob(ex, "3", ctx0[0], fusionnet, cmd, opt);
+                input_blob(ex, "4", ctx0[1], fusionnet, cmd, opt);
+                input_blob(ex, "5", ctx0[2], fusionnet, cmd, opt);
+                input_blob(ex, "6", ctx0[3], fusionnet, cmd, opt);
+                input_blob(ex, "7", ctx1[0], fusionnet, cmd, opt);
+                input_blob(ex, "8", ctx1[1], fusionnet, cmd, opt);
+                input_blob(ex, "9", ctx1[2], fusionnet, cmd, opt);
+                input_blob(ex, "10", ctx1[3], fusionnet, cmd, opt);
+
+                ex.extract("output", out_gpu_padded, cmd);
             }
 
             if (tta_temporal_mode)
@@ -755,38 +1357,17 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                     ex.set_workspace_vkallocator(blob_vkallocator);
                     ex.set_staging_vkallocator(staging_vkallocator);
 
-                    ex.input("img0", in1_gpu_padded[ti]);
-                    ex.input("img1", in0_gpu_padded[ti]);
-                    ex.input("flow", flow_reversed[ti]);
-                    ex.input("3", ctx1[0]);
-                    ex.input("4", ctx1[1]);
-                    ex.input("5", ctx1[2]);
-                    ex.input("6", ctx1[3]);
-                    ex.input("7", ctx0[0]);
-                    ex.input("8", ctx0[1]);
-                    ex.input("9", ctx0[2]);
-                    ex.input("10", ctx0[3]);
-
-                    // save some memory
-                    if (ti == 0)
-                    {
-                        in0_gpu.release();
-                        in1_gpu.release();
-                    }
-                    else
-                    {
-                        in0_gpu_padded[ti - 1].release();
-                        in1_gpu_padded[ti - 1].release();
-                        flow_reversed[ti - 1].release();
-                    }
-                    ctx0[0].release();
-                    ctx0[1].release();
-                    ctx0[2].release();
-                    ctx0[3].release();
-                    ctx1[0].release();
-                    ctx1[1].release();
-                    ctx1[2].release();
-                    ctx1[3].release();
+                    input_blob(ex, "img0", in1_gpu_padded, fusionnet, cmd, opt);
+                    input_blob(ex, "img1", in0_gpu_padded, fusionnet, cmd, opt);
+                    input_blob(ex, "flow", flow[1], fusionnet, cmd, opt);
+                    input_blob(ex, "3", ctx1[0], fusionnet, cmd, opt);
+                    input_blob(ex, "4", ctx1[1], fusionnet, cmd, opt);
+                    input_blob(ex, "5", ctx1[2], fusionnet, cmd, opt);
+                    input_blob(ex, "6", ctx1[3], fusionnet, cmd, opt);
+                    input_blob(ex, "7", ctx0[0], fusionnet, cmd, opt);
+                    input_blob(ex, "8", ctx0[1], fusionnet, cmd, opt);
+                    input_blob(ex, "9", ctx0[2], fusionnet, cmd, opt);
+                    input_blob(ex, "10", ctx0[3], fusionnet, cmd, opt);
 
                     ex.extract("output", out_gpu_padded_reversed, cmd);
                 }
@@ -794,48 +1375,48 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 // merge output
                 {
                     std::vector<ncnn::VkMat> bindings(2);
-                    bindings[0] = out_gpu_padded[ti];
+                    bindings[0] = out_gpu_padded;
                     bindings[1] = out_gpu_padded_reversed;
 
                     std::vector<ncnn::vk_constant_type> constants(3);
-                    constants[0].i = out_gpu_padded[ti].w;
-                    constants[1].i = out_gpu_padded[ti].h;
-                    constants[2].i = out_gpu_padded[ti].cstep;
+                    constants[0].i = out_gpu_padded.w;
+                    constants[1].i = out_gpu_padded.h;
+                    constants[2].i = out_gpu_padded.cstep;
 
                     ncnn::VkMat dispatcher;
-                    dispatcher.w = out_gpu_padded[ti].w;
-                    dispatcher.h = out_gpu_padded[ti].h;
+                    dispatcher.w = out_gpu_padded.w;
+                    dispatcher.h = out_gpu_padded.h;
                     dispatcher.c = 3;
                     cmd.record_pipeline(rife_out_tta_temporal_avg, bindings, constants, dispatcher);
                 }
             }
+
+            record_tta_sum(rife_out_tta_sum, out_gpu_padded, out_sum, ti, i == 0, 3, cmd);
+
+            timer.gpu(&RIFEProfile::fusionnet, cmd);
         }
 
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
         {
-            std::vector<ncnn::VkMat> bindings(9);
-            bindings[0] = out_gpu_padded[0];
-            bindings[1] = out_gpu_padded[1];
-            bindings[2] = out_gpu_padded[2];
-            bindings[3] = out_gpu_padded[3];
-            bindings[4] = out_gpu_padded[4];
-            bindings[5] = out_gpu_padded[5];
-            bindings[6] = out_gpu_padded[6];
-            bindings[7] = out_gpu_padded[7];
-            bindings[8] = out_gpu;
+            std::vector<ncnn::VkMat> bindings(2);
+            bindings[0] = out_sum;
+            bindings[1] = out_gpu;
 
-            std::vector<ncnn::vk_constant_type> constants(6);
-            constants[0].i = out_gpu_padded[0].w;
-            constants[1].i = out_gpu_padded[0].h;
-            constants[2].i = out_gpu_padded[0].cstep;
+            std::vector<ncnn::vk_constant_type> constants(7);
+            constants[0].i = out_sum.w;
+            constants[1].i = out_sum.h;
+            constants[2].i = out_sum.cstep;
             constants[3].i = out_gpu.w;
             constants[4].i = out_gpu.h;
             constants[5].i = out_gpu.cstep;
+            constants[6].i = tta_count;
 
             cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu);
         }
+
+        timer.gpu(&RIFEProfile::postproc, cmd);
     }
     else
     {
@@ -877,6 +1458,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded);
         }
 
+        timer.gpu(&RIFEProfile::preproc, cmd);
+
         // flownet
         ncnn::VkMat flow;
         ncnn::VkMat flow0;
@@ -900,10 +1483,10 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ncnn::VkMat flow_downscaled;
                 ex.extract("flow", flow_downscaled, cmd);
 
-                ncnn::VkMat flow_half;
-                rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
+                ncnn::VkMat flow_upscaled;
+                rife_uhd_upscale_flow->forward(flow_downscaled, flow_upscaled, cmd, opt);
 
-                rife_uhd_double_flow->forward(flow_half, flow, cmd, opt);
+                rife_uhd_scale_flow->forward(flow_upscaled, flow, cmd, opt);
             }
             else
             {
@@ -935,10 +1518,10 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ncnn::VkMat flow_downscaled;
                 ex.extract("flow", flow_downscaled, cmd);
 
-                ncnn::VkMat flow_half;
-                rife_uhd_upscale_flow->forward(flow_downscaled, flow_half, cmd, opt);
+                ncnn::VkMat flow_upscaled;
+                rife_uhd_upscale_flow->forward(flow_downscaled, flow_upscaled, cmd, opt);
 
-                rife_uhd_double_flow->forward(flow_half, flow_reversed, cmd, opt);
+                rife_uhd_scale_flow->forward(flow_upscaled, flow_reversed, cmd, opt);
             }
             else
             {
@@ -977,6 +1560,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             flow1 = outputs[1];
         }
 
+        timer.gpu(&RIFEProfile::flownet, cmd);
+
         // contextnet
         ncnn::VkMat ctx0[4];
         ncnn::VkMat ctx1[4];
@@ -986,14 +1571,14 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             ex.set_workspace_vkallocator(blob_vkallocator);
             ex.set_staging_vkallocator(staging_vkallocator);
 
-            ex.input("input.1", in0_gpu_padded);
+            input_blob(ex, "input.1", in0_gpu_padded, contextnet, cmd, opt);
             if (rife_v2)
             {
-                ex.input("flow.0", flow0);
+                input_blob(ex, "flow.0", flow0, contextnet, cmd, opt);
             }
             else
             {
-                ex.input("flow.0", flow);
+                input_blob(ex, "flow.0", flow, contextnet, cmd, opt);
             }
             ex.extract("f1", ctx0[0], cmd);
             ex.extract("f2", ctx0[1], cmd);
@@ -1006,14 +1591,14 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             ex.set_workspace_vkallocator(blob_vkallocator);
             ex.set_staging_vkallocator(staging_vkallocator);
 
-            ex.input("input.1", in1_gpu_padded);
+            input_blob(ex, "input.1", in1_gpu_padded, contextnet, cmd, opt);
             if (rife_v2)
             {
-                ex.input("flow.0", flow1);
+                input_blob(ex, "flow.0", flow1, contextnet, cmd, opt);
             }
             else
             {
-                ex.input("flow.1", flow);
+                input_blob(ex, "flow.1", flow, contextnet, cmd, opt);
             }
             ex.extract("f1", ctx1[0], cmd);
             ex.extract("f2", ctx1[1], cmd);
@@ -1021,6 +1606,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             ex.extract("f4", ctx1[3], cmd);
         }
 
+        timer.gpu(&RIFEProfile::contextnet, cmd);
+
         // fusionnet
         ncnn::VkMat out_gpu_padded;
         {
@@ -1029,17 +1616,17 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             ex.set_workspace_vkallocator(blob_vkallocator);
             ex.set_staging_vkallocator(staging_vkallocator);
 
-            ex.input("img0", in0_gpu_padded);
-            ex.input("img1", in1_gpu_padded);
-            ex.input("flow", flow);
-            ex.input("3", ctx0[0]);
-            ex.input("4", ctx0[1]);
-            ex.input("5", ctx0[2]);
-            ex.input("6", ctx0[3]);
-            ex.input("7", ctx1[0]);
-            ex.input("8", ctx1[1]);
-            ex.input("9", ctx1[2]);
-            ex.input("10", ctx1[3]);
+            input_blob(ex, "img0", in0_gpu_padded, fusionnet, cmd, opt);
+            input_blob(ex, "img1", in1_gpu_padded, fusionnet, cmd, opt);
+            input_blob(ex, "flow", flow, fusionnet, cmd, opt);
+            input_blob(ex, "3", ctx0[0], fusionnet, cmd, opt);
+            input_blob(ex, "4", ctx0[1], fusionnet, cmd, opt);
+            input_blob(ex, "5", ctx0[2], fusionnet, cmd, opt);
+            input_blob(ex, "6", ctx0[3], fusionnet, cmd, opt);
+            input_blob(ex, "7", ctx1[0], fusionnet, cmd, opt);
+            input_blob(ex, "8", ctx1[1], fusionnet, cmd, opt);
+            input_blob(ex, "9", ctx1[2], fusionnet, cmd, opt);
+            input_blob(ex, "10", ctx1[3], fusionnet, cmd, opt);
 
             if (!tta_temporal_mode)
             {
@@ -1070,17 +1657,17 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 ex.set_workspace_vkallocator(blob_vkallocator);
                 ex.set_staging_vkallocator(staging_vkallocator);
 
-                ex.input("img0", in1_gpu_padded);
-                ex.input("img1", in0_gpu_padded);
-                ex.input("flow", flow_reversed);
-                ex.input("3", ctx1[0]);
-                ex.input("4", ctx1[1]);
-                ex.input("5", ctx1[2]);
-                ex.input("6", ctx1[3]);
-                ex.input("7", ctx0[0]);
-                ex.input("8", ctx0[1]);
-                ex.input("9", ctx0[2]);
-                ex.input("10", ctx0[3]);
+                input_blob(ex, "img0", in1_gpu_padded, fusionnet, cmd, opt);
+                input_blob(ex, "img1", in0_gpu_padded, fusionnet, cmd, opt);
+                input_blob(ex, "flow", flow_reversed, fusionnet, cmd, opt);
+                input_blob(ex, "3", ctx1[0], fusionnet, cmd, opt);
+                input_blob(ex, "4", ctx1[1], fusionnet, cmd, opt);
+                input_blob(ex, "5", ctx1[2], fusionnet, cmd, opt);
+                input_blob(ex, "6", ctx1[3], fusionnet, cmd, opt);
+                input_blob(ex, "7", ctx0[0], fusionnet, cmd, opt);
+                input_blob(ex, "8", ctx0[1], fusionnet, cmd, opt);
+                input_blob(ex, "9", ctx0[2], fusionnet, cmd, opt);
+                input_blob(ex, "10", ctx0[3], fusionnet, cmd, opt);
 
                 // save some memory
                 in0_gpu.release();
@@ -1117,6 +1704,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
             }
         }
 
+        timer.gpu(&RIFEProfile::fusionnet, cmd);
+
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
@@ -1135,6 +1724,8 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
 
             cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu);
         }
+
+        timer.gpu(&RIFEProfile::postproc, cmd);
     }
 
     // download
@@ -1143,7 +1734,7 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
 
         cmd.record_clone(out_gpu, out, opt);
 
-        cmd.submit_and_wait();
+        timer.wait(&RIFEProfile::download, cmd);
 
         const float* outR{ out.channel(0) };
         const float* outG{ out.channel(1) };
@@ -1155,10 +1746,12 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
                 dstB[stride * y + x] = outB[w * y + x] * (1 / 255.0f);
             }
         }
+
+        timer.host(&RIFEProfile::convert);
     }
 
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
+    vkdev->reclaim_blob_allocator(blob_counter.allocator);
+    vkdev->reclaim_staging_allocator(staging_counter.allocator);
 
     return 0;
 }
@@ -1166,14 +1759,23 @@ int RIFE::process(const float* src0R, const float* src0G, const float* src0B,
 int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
                      const float* src1R, const float* src1G, const float* src1B,
                      float* dstR, float* dstG, float* dstB,
-                     const int w, const int h, const ptrdiff_t stride, const float timestep) const
+                     const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile, bool scene_change) const
 {
+    if (!vkdev)
+        return process_v4_cpu(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, w, h, stride, timestep, profile);
+
+    StageTimer timer(profile);
+
     const int channels = 3;//in0image.elempack;
 
 //     fprintf(stderr, "%d x %d\n", w, h);
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    // declared first so that they outlive every mat allocated from them
+    CountingVkAllocator blob_counter(vkdev->acquire_blob_allocator(), device_memory(vkdev).blob, profile ? &profile->blob_peak : 0);
+    CountingVkAllocator staging_counter(vkdev->acquire_staging_allocator(), device_memory(vkdev).staging, profile ? &profile->staging_peak : 0);
+
+    ncnn::VkAllocator* blob_vkallocator = &blob_counter;
+    ncnn::VkAllocator* staging_vkallocator = &staging_counter;
 
     ncnn::Option opt = flownet.opt;
     opt.blob_vkallocator = blob_vkallocator;
@@ -1208,6 +1810,8 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
         }
     }
 
+    timer.host(&RIFEProfile::convert);
+
     ncnn::VkCompute cmd(vkdev);
 
     // upload
@@ -1218,13 +1822,26 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
         cmd.record_clone(in1, in1_gpu, opt);
     }
 
+    timer.gpu(&RIFEProfile::upload, cmd);
+
+    if (scene_change && rife_sc_blocks && detect_scene_change(in0_gpu, in1_gpu, cmd, opt))
+    {
+        timer.host(&RIFEProfile::scene_change);
+
+        vkdev->reclaim_blob_allocator(blob_counter.allocator);
+        vkdev->reclaim_staging_allocator(staging_counter.allocator);
+
+        return RIFE_SCENE_CHANGE;
+    }
+
+    timer.host(&RIFEProfile::scene_change);
+
     ncnn::VkMat out_gpu;
 
     {
         // preproc
         ncnn::VkMat in0_gpu_padded;
         ncnn::VkMat in1_gpu_padded;
-        ncnn::VkMat timestep_gpu_padded;
         {
             in0_gpu_padded.create(w_padded, h_padded, 3, in_out_tile_elemsize, 1, blob_vkallocator);
 
@@ -1259,20 +1876,8 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
 
             cmd.record_pipeline(rife_preproc, bindings, constants, in1_gpu_padded);
         }
-        {
-            timestep_gpu_padded.create(w_padded, h_padded, 1, in_out_tile_elemsize, 1, blob_vkallocator);
 
-            std::vector<ncnn::VkMat> bindings(1);
-            bindings[0] = timestep_gpu_padded;
-
-            std::vector<ncnn::vk_constant_type> constants(4);
-            constants[0].i = timestep_gpu_padded.w;
-            constants[1].i = timestep_gpu_padded.h;
-            constants[2].i = timestep_gpu_padded.cstep;
-            constants[3].f = timestep;
-
-            cmd.record_pipeline(rife_v4_timestep, bindings, constants, timestep_gpu_padded);
-        }
+        timer.gpu(&RIFEProfile::preproc, cmd);
 
         // flownet
         ncnn::VkMat out_gpu_padded;
@@ -1284,10 +1889,15 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
 
             ex.input("in0", in0_gpu_padded);
             ex.input("in1", in1_gpu_padded);
-            ex.input("in2", timestep_gpu_padded);
+            // a single value, broadcast by the network, see broadcast_timestep
+            ncnn::Mat timestep_blob(1);
+            timestep_blob[0] = timestep;
+            ex.input("in2", timestep_blob);
             ex.extract("out0", out_gpu_padded, cmd);
         }
 
+        timer.gpu(&RIFEProfile::flownet, cmd);
+
         out_gpu.create(w, h, channels, sizeof(float), 1, blob_vkallocator);
 
         // postproc
@@ -1306,6 +1916,8 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
 
             cmd.record_pipeline(rife_postproc, bindings, constants, out_gpu);
         }
+
+        timer.gpu(&RIFEProfile::postproc, cmd);
     }
 
     // download
@@ -1314,7 +1926,7 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
 
         cmd.record_clone(out_gpu, out, opt);
 
-        cmd.submit_and_wait();
+        timer.wait(&RIFEProfile::download, cmd);
 
         const float* outR{ out.channel(0) };
         const float* outG{ out.channel(1) };
@@ -1326,10 +1938,420 @@ int RIFE::process_v4(const float* src0R, const float* src0G, const float* src0B,
                 dstB[stride * y + x] = outB[w * y + x] * (1 / 255.0f);
             }
         }
+
+        timer.host(&RIFEProfile::convert);
+    }
+
+    vkdev->reclaim_blob_allocator(blob_counter.allocator);
+    vkdev->reclaim_staging_allocator(staging_counter.allocator);
+
+    return 0;
+}
+
+// offset of pixel (x, y) of a w x h image in its flipped/transposed copy, as in the tta shaders
+static int variant_offset(int variant, int x, int y, int w, int h)
+{
+    if (variant == 0) return y * w + x;
+    if (variant == 1) return y * w + (w - 1 - x);
+    if (variant == 2) return (h - 1 - y) * w + (w - 1 - x);
+    if (variant == 3) return (h - 1 - y) * w + x;
+    if (variant == 4) return x * h + y;
+    if (variant == 5) return x * h + (h - 1 - y);
+    if (variant == 6) return (w - 1 - x) * h + (h - 1 - y);
+    return (w - 1 - x) * h + y;
+}
+
+// flow of a flipped/transposed copy in the orientation of the input
+static void flow_from_variant(int variant, float& x, float& y)
+{
+    const float fx = x;
+    const float fy = y;
+    if (variant == 0) { x = fx; y = fy; }
+    else if (variant == 1) { x = -fx; y = fy; }
+    else if (variant == 2) { x = -fx; y = -fy; }
+    else if (variant == 3) { x = fx; y = -fy; }
+    else if (variant == 4) { x = fy; y = fx; }
+    else if (variant == 5) { x = fy; y = -fx; }
+    else if (variant == 6) { x = -fy; y = -fx; }
+    else { x = -fy; y = fx; }
+}
+
+// flow in the orientation of the input as seen by a flipped/transposed copy
+static void flow_to_variant(int variant, float& x, float& y)
+{
+    const float fx = x;
+    const float fy = y;
+    if (variant == 0) { x = fx; y = fy; }
+    else if (variant == 1) { x = -fx; y = fy; }
+    else if (variant == 2) { x = -fx; y = -fy; }
+    else if (variant == 3) { x = fx; y = -fy; }
+    else if (variant == 4) { x = fy; y = fx; }
+    else if (variant == 5) { x = -fy; y = fx; }
+    else if (variant == 6) { x = -fy; y = -fx; }
+    else { x = fy; y = -fx; }
+}
+
+// padded copy of the planes, flipped/transposed for tta variant, the same as rife_preproc(_tta)
+static void preproc_cpu(const float* srcR, const float* srcG, const float* srcB, int w, int h, ptrdiff_t stride, ncnn::Mat& out, int variant, int w_padded, int h_padded)
+{
+    if (variant < 4)
+        out.create(w_padded, h_padded, 3);
+    else
+        out.create(h_padded, w_padded, 3);
+
+    const float* planes[3] = { srcR, srcG, srcB };
+
+    for (int q = 0; q < 3; q++)
+    {
+        float* outptr = out.channel(q);
+
+        for (int y = 0; y < h_padded; y++)
+        {
+            for (int x = 0; x < w_padded; x++)
+            {
+                outptr[variant_offset(variant, x, y, w_padded, h_padded)] = x < w && y < h ? planes[q][stride * y + x] : 0.f;
+            }
+        }
+    }
+}
+
+// sum += flow of tta variant turned back to the orientation of the input, sum is overwritten when first is set
+// every pair of channels is a flow, so that the 4 channel flows of v2 are handled too
+static void flow_tta_sum_cpu(const ncnn::Mat& flow, ncnn::Mat& sum, int variant, bool first)
+{
+    if (first)
+    {
+        sum.create(flow.w, flow.h, flow.c);
+    }
+
+    for (int q = 0; q + 1 < flow.c; q += 2)
+    {
+        const float* fxptr = flow.channel(q);
+        const float* fyptr = flow.channel(q + 1);
+        float* sxptr = sum.channel(q);
+        float* syptr = sum.channel(q + 1);
+
+        for (int y = 0; y < sum.h; y++)
+        {
+            for (int x = 0; x < sum.w; x++)
+            {
+                const int v_offset = variant_offset(variant, x, y, sum.w, sum.h);
+                float fx = fxptr[v_offset];
+                float fy = fyptr[v_offset];
+                flow_from_variant(variant, fx, fy);
+
+                const int s_offset = y * sum.w + x;
+                sxptr[s_offset] = first ? fx : sxptr[s_offset] + fx;
+                syptr[s_offset] = first ? fy : syptr[s_offset] + fy;
+            }
+        }
+    }
+}
+
+// average of the flow sums as seen by tta variant
+static void flow_tta_avg_cpu(const ncnn::Mat& sum, ncnn::Mat& flow, int variant, int count)
+{
+    if (variant < 4)
+        flow.create(sum.w, sum.h, sum.c);
+    else
+        flow.create(sum.h, sum.w, sum.c);
+
+    for (int q = 0; q + 1 < sum.c; q += 2)
+    {
+        const float* sxptr = sum.channel(q);
+        const float* syptr = sum.channel(q + 1);
+        float* fxptr = flow.channel(q);
+        float* fyptr = flow.channel(q + 1);
+
+        for (int y = 0; y < sum.h; y++)
+        {
+            for (int x = 0; x < sum.w; x++)
+            {
+                const int s_offset = y * sum.w + x;
+                float fx = sxptr[s_offset] / count;
+                float fy = syptr[s_offset] / count;
+                flow_to_variant(variant, fx, fy);
+
+                const int v_offset = variant_offset(variant, x, y, sum.w, sum.h);
+                fxptr[v_offset] = fx;
+                fyptr[v_offset] = fy;
+            }
+        }
+    }
+}
+
+// sum += output of tta variant turned back to the orientation of the input, sum is overwritten when first is set
+static void out_tta_sum_cpu(const ncnn::Mat& out, ncnn::Mat& sum, int variant, bool first)
+{
+    for (int q = 0; q < 3; q++)
+    {
+        const float* outptr = out.channel(q);
+        float* sumptr = sum.channel(q);
+
+        for (int y = 0; y < sum.h; y++)
+        {
+            for (int x = 0; x < sum.w; x++)
+            {
+                const float v = outptr[variant_offset(variant, x, y, sum.w, sum.h)];
+                sumptr[y * sum.w + x] = first ? v : sumptr[y * sum.w + x] + v;
+            }
+        }
+    }
+}
+
+// the same as rife_postproc(_tta) followed by the conversion to 0..1 of process
+static void postproc_cpu(const ncnn::Mat& out, int count, float* dstR, float* dstG, float* dstB, int w, int h, ptrdiff_t stride)
+{
+    float* planes[3] = { dstR, dstG, dstB };
+
+    for (int q = 0; q < 3; q++)
+    {
+        const float* outptr = out.channel(q);
+
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                planes[q][stride * y + x] = (outptr[y * out.w + x] / count * 255.f + 0.5f) * (1 / 255.0f);
+            }
+        }
+    }
+}
+
+void RIFE::flownet_cpu(const ncnn::Mat& in0, const ncnn::Mat& in1, ncnn::Mat& flow) const
+{
+    ncnn::Extractor ex = flownet.create_extractor();
+
+    if (uhd_mode)
+    {
+        ncnn::Mat in0_downscaled;
+        ncnn::Mat in1_downscaled;
+        rife_uhd_downscale_image->forward(in0, in0_downscaled, flownet.opt);
+        rife_uhd_downscale_image->forward(in1, in1_downscaled, flownet.opt);
+
+        ex.input("input0", in0_downscaled);
+        ex.input("input1", in1_downscaled);
+
+        ncnn::Mat flow_downscaled;
+        ex.extract("flow", flow_downscaled);
+
+        ncnn::Mat flow_upscaled;
+        rife_uhd_upscale_flow->forward(flow_downscaled, flow_upscaled, flownet.opt);
+
+        rife_uhd_scale_flow->forward(flow_upscaled, flow, flownet.opt);
+    }
+    else
+    {
+        ex.input("input0", in0);
+        ex.input("input1", in1);
+        ex.extract("flow", flow);
+    }
+}
+
+void RIFE::fusion_cpu(const ncnn::Mat& in0, const ncnn::Mat& in1, const ncnn::Mat& flow, ncnn::Mat& out, StageTimer& timer) const
+{
+    ncnn::Mat flow0;
+    ncnn::Mat flow1;
+    if (rife_v2)
+    {
+        std::vector<ncnn::Mat> inputs(1);
+        inputs[0] = flow;
+        std::vector<ncnn::Mat> outputs(2);
+        rife_v2_slice_flow->forward(inputs, outputs, flownet.opt);
+        flow0 = outputs[0];
+        flow1 = outputs[1];
+    }
+
+    // contextnet
+    ncnn::Mat ctx0[4];
+    ncnn::Mat ctx1[4];
+    {
+        ncnn::Extractor ex = contextnet.create_extractor();
+
+        ex.input("input.1", in0);
+        if (rife_v2)
+        {
+            ex.input("flow.0", flow0);
+        }
+        else
+        {
+            ex.input("flow.0", flow);
+        }
+        ex.extract("f1", ctx0[0]);
+        ex.extract("f2", ctx0[1]);
+        ex.extract("f3", ctx0[2]);
+        ex.extract("f4", ctx0[3]);
+    }
+    {
+        ncnn::Extractor ex = contextnet.create_extractor();
+
+        ex.input("input.1", in1);
+        if (rife_v2)
+        {
+            ex.input("flow.0", flow1);
+        }
+        else
+        {
+            ex.input("flow.1", flow);
+        }
+        ex.extract("f1", ctx1[0]);
+        ex.extract("f2", ctx1[1]);
+        ex.extract("f3", ctx1[2]);
+        ex.extract("f4", ctx1[3]);
+    }
+
+    timer.host(&RIFEProfile::contextnet);
+
+    // fusionnet
+    {
+        ncnn::Extractor ex = fusionnet.create_extractor();
+
+        ex.input("img0", in0);
+        ex.input("img1", in1);
+        ex.input("flow", flow);
+        ex.input("3", ctx0[0]);
+        ex.input("4", ctx0[1]);
+        ex.input("5", ctx0[2]);
+        ex.input("6", ctx0[3]);
+        ex.input("7", ctx1[0]);
+        ex.input("8", ctx1[1]);
+        ex.input("9", ctx1[2]);
+        ex.input("10", ctx1[3]);
+
+        ex.extract("output", out);
+    }
+
+    timer.host(&RIFEProfile::fusionnet);
+}
+
+// tta_temporal_mode is never enabled and has no cpu implementation
+int RIFE::process_cpu(const float* src0R, const float* src0G, const float* src0B,
+                      const float* src1R, const float* src1G, const float* src1B,
+                      float* dstR, float* dstG, float* dstB,
+                      const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile) const
+{
+    if (rife_v4)
+        return process_v4_cpu(src0R, src0G, src0B, src1R, src1G, src1B, dstR, dstG, dstB, w, h, stride, timestep, profile);
+
+    StageTimer timer(profile);
+
+    // pad to 32n
+    int w_padded = (w + padding - 1) / padding * padding;
+    int h_padded = (h + padding - 1) / padding * padding;
+
+    if (tta_mode)
+    {
+        // the same two passes as on the gpu, the flow averaged over all variants first
+        const int tta_count = tta_mode;
+
+        ncnn::Mat flow_sum;
+        for (int i = 0; i < tta_count; i++)
+        {
+            const int ti = tta_variant(tta_count, i);
+
+            ncnn::Mat in0_padded;
+            ncnn::Mat in1_padded;
+            preproc_cpu(src0R, src0G, src0B, w, h, stride, in0_padded, ti, w_padded, h_padded);
+            preproc_cpu(src1R, src1G, src1B, w, h, stride, in1_padded, ti, w_padded, h_padded);
+
+            timer.host(&RIFEProfile::preproc);
+
+            ncnn::Mat flow;
+            flownet_cpu(in0_padded, in1_padded, flow);
+
+            // the first variant is never flipped, its shape is the one of the sum
+            flow_tta_sum_cpu(flow, flow_sum, ti, i == 0);
+
+            timer.host(&RIFEProfile::flownet);
+        }
+
+        ncnn::Mat out_sum(w_padded, h_padded, 3);
+        for (int i = 0; i < tta_count; i++)
+        {
+            const int ti = tta_variant(tta_count, i);
+
+            ncnn::Mat in0_padded;
+            ncnn::Mat in1_padded;
+            preproc_cpu(src0R, src0G, src0B, w, h, stride, in0_padded, ti, w_padded, h_padded);
+            preproc_cpu(src1R, src1G, src1B, w, h, stride, in1_padded, ti, w_padded, h_padded);
+
+            timer.host(&RIFEProfile::preproc);
+
+            ncnn::Mat flow;
+            flow_tta_avg_cpu(flow_sum, flow, ti, tta_count);
+
+            timer.host(&RIFEProfile::flownet);
+
+            ncnn::Mat out_padded;
+            fusion_cpu(in0_padded, in1_padded, flow, out_padded, timer);
+
+            out_tta_sum_cpu(out_padded, out_sum, ti, i == 0);
+
+            timer.host(&RIFEProfile::fusionnet);
+        }
+
+        postproc_cpu(out_sum, tta_count, dstR, dstG, dstB, w, h, stride);
+    }
+    else
+    {
+        ncnn::Mat in0_padded;
+        ncnn::Mat in1_padded;
+        preproc_cpu(src0R, src0G, src0B, w, h, stride, in0_padded, 0, w_padded, h_padded);
+        preproc_cpu(src1R, src1G, src1B, w, h, stride, in1_padded, 0, w_padded, h_padded);
+
+        timer.host(&RIFEProfile::preproc);
+
+        ncnn::Mat flow;
+        flownet_cpu(in0_padded, in1_padded, flow);
+
+        timer.host(&RIFEProfile::flownet);
+
+        ncnn::Mat out_padded;
+        fusion_cpu(in0_padded, in1_padded, flow, out_padded, timer);
+
+        postproc_cpu(out_padded, 1, dstR, dstG, dstB, w, h, stride);
     }
 
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
+    timer.host(&RIFEProfile::postproc);
+
+    return 0;
+}
+
+int RIFE::process_v4_cpu(const float* src0R, const float* src0G, const float* src0B,
+                         const float* src1R, const float* src1G, const float* src1B,
+                         float* dstR, float* dstG, float* dstB,
+                         const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile) const
+{
+    StageTimer timer(profile);
+
+    int w_padded = (w + padding - 1) / padding * padding;
+    int h_padded = (h + padding - 1) / padding * padding;
+
+    ncnn::Mat in0_padded;
+    ncnn::Mat in1_padded;
+    preproc_cpu(src0R, src0G, src0B, w, h, stride, in0_padded, 0, w_padded, h_padded);
+    preproc_cpu(src1R, src1G, src1B, w, h, stride, in1_padded, 0, w_padded, h_padded);
+
+    timer.host(&RIFEProfile::preproc);
+
+    ncnn::Mat out_padded;
+    {
+        ncnn::Extractor ex = flownet.create_extractor();
+
+        ex.input("in0", in0_padded);
+        ex.input("in1", in1_padded);
+        // a single value, broadcast by the network, see broadcast_timestep
+        ncnn::Mat timestep_blob(1);
+        timestep_blob[0] = timestep;
+        ex.input("in2", timestep_blob);
+        ex.extract("out0", out_padded);
+    }
+
+    timer.host(&RIFEProfile::flownet);
+
+    postproc_cpu(out_padded, 1, dstR, dstG, dstB, w, h, stride);
+
+    timer.host(&RIFEProfile::postproc);
 
     return 0;
 }
@@ -4,54 +4,162 @@
 #define RIFE_H
 
 #include <string>
+#include <vector>
 
 // ncnn
 #include "net.h"
 
+#include "model_pack.h"
+
+class StageTimer;
+
+// precision modes for set_precision
+#define RIFE_PRECISION_FP32 0
+#define RIFE_PRECISION_FP16_STORAGE 1
+#define RIFE_PRECISION_FP16_ARITHMETIC 2
+
+// returned by process when the frames are detected as a scene change, dst is left untouched
+#define RIFE_SCENE_CHANGE 1
+
+struct RIFEProfile;
+
+// a stage of process from start to end, in ncnn::get_current_time milliseconds
+struct RIFESpan
+{
+    double RIFEProfile::*stage;
+    double start;
+    double end;
+};
+
+// time spent in each stage of process in milliseconds, added to the existing values
+struct RIFEProfile
+{
+    double convert;
+    double upload;
+    double scene_change;
+    double preproc;
+    double flownet;
+    double contextnet;
+    double fusionnet;
+    double postproc;
+    double download;
+
+    // without serialize the gpu stages are not told apart, the commands are only submitted once
+    // and the time is split into recording them and waiting for the gpu to run them, the download included
+    double record;
+    double gpu;
+
+    // submit and wait for the commands of every gpu stage on its own, slower than a normal run
+    bool serialize;
+
+    // every stage is appended here too when set
+    std::vector<RIFESpan>* spans;
+
+    // most bytes held at once by the blob and staging allocators of process, kept if larger
+    size_t blob_peak;
+    size_t staging_peak;
+};
+
+// gpu memory in bytes
+struct RIFEMemory
+{
+    // held by the blob and staging allocators of every process on the device, now and at most so far
+    size_t blob;
+    size_t blob_peak;
+    size_t staging;
+    size_t staging_peak;
+
+    // the weights of each network at their storage precision, counted as they are read while loading
+    size_t flownet;
+    size_t contextnet;
+    size_t fusionnet;
+};
+
 class RIFE
 {
 public:
-    RIFE(int gpuid, bool tta_mode = false, bool uhd_mode = false, int num_threads = 1, bool rife_v2 = false, bool rife_v4 = false, int padding = 32);
+    RIFE(int gpuid, int tta_mode = 0, bool uhd_mode = false, int num_threads = 1, bool rife_v2 = false, bool rife_v4 = false, int padding = 32, float scale = 1.f);
     ~RIFE();
 
+    // must be called before load, contextnet and fusionnet are ignored for rife-v4
+    void set_precision(int flownet_precision, int contextnet_precision, int fusionnet_precision);
+
+    // must be called before load, the two frames are treated as a scene change and not interpolated when the mean colors
+    // of more than half of the blocks of a 16x16 grid differ by more than threshold in 0..1, 0 disables the detection
+    void set_scene_change_threshold(float threshold);
+
 #if _WIN32
     int load(const std::wstring& modeldir);
 #else
     int load(const std::string& modeldir);
 #endif
 
+    // the precision each network runs at once loaded, fp16 arithmetic falls back to fp16 storage on devices
+    // without it, and the cpu always runs fp32
+    void get_precision(int& flownet_precision, int& contextnet_precision, int& fusionnet_precision) const;
+
+    // zero on the cpu
+    RIFEMemory memory() const;
+
+    // with profile, every stage is submitted and waited for on its own, which is slower
+    // without scene_change the frames are not tested for a scene change, for parts of a frame that was tested as a whole
     int process(const float* src0R, const float* src0G, const float* src0B,
                 const float* src1R, const float* src1G, const float* src1B,
                 float* dstR, float* dstG, float* dstB,
-                const int w, const int h, const ptrdiff_t stride, const float timestep) const;
+                const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile = 0, bool scene_change = true) const;
 
     int process_v4(const float* src0R, const float* src0G, const float* src0B,
                    const float* src1R, const float* src1G, const float* src1B,
                    float* dstR, float* dstG, float* dstB,
-                   const int w, const int h, const ptrdiff_t stride, const float timestep) const;
+                   const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile = 0, bool scene_change = true) const;
+
+    // the same on the cpu, used when gpuid is -1
+    int process_cpu(const float* src0R, const float* src0G, const float* src0B,
+                    const float* src1R, const float* src1G, const float* src1B,
+                    float* dstR, float* dstG, float* dstB,
+                    const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile = 0) const;
+
+    int process_v4_cpu(const float* src0R, const float* src0G, const float* src0B,
+                       const float* src1R, const float* src1G, const float* src1B,
+                       float* dstR, float* dstG, float* dstB,
+                       const int w, const int h, const ptrdiff_t stride, const float timestep, RIFEProfile* profile = 0) const;
+
+private:
+    bool detect_scene_change(const ncnn::VkMat& in0_gpu, const ncnn::VkMat& in1_gpu, ncnn::VkCompute& cmd, const ncnn::Option& opt) const;
+
+    void flownet_cpu(const ncnn::Mat& in0, const ncnn::Mat& in1, ncnn::Mat& flow) const;
+    void fusion_cpu(const ncnn::Mat& in0, const ncnn::Mat& in1, const ncnn::Mat& flow, ncnn::Mat& out, StageTimer& timer) const;
 
 private:
     ncnn::VulkanDevice* vkdev;
+    // referenced by the weights of the cpu backend, released after loading when every layer runs on the gpu
+    ModelPack pack;
     ncnn::Net flownet;
     ncnn::Net contextnet;
     ncnn::Net fusionnet;
     ncnn::Pipeline* rife_preproc;
     ncnn::Pipeline* rife_postproc;
+    ncnn::Pipeline* rife_flow_tta_sum;
     ncnn::Pipeline* rife_flow_tta_avg;
     ncnn::Pipeline* rife_flow_tta_temporal_avg;
     ncnn::Pipeline* rife_out_tta_temporal_avg;
-    ncnn::Pipeline* rife_v4_timestep;
+    ncnn::Pipeline* rife_out_tta_sum;
+    ncnn::Pipeline* rife_sc_blocks;
     ncnn::Layer* rife_uhd_downscale_image;
     ncnn::Layer* rife_uhd_upscale_flow;
-    ncnn::Layer* rife_uhd_double_flow;
+    ncnn::Layer* rife_uhd_scale_flow;
     ncnn::Layer* rife_v2_slice_flow;
-    bool tta_mode;
+    int tta_mode;
     bool tta_temporal_mode;
     bool uhd_mode;
     int num_threads;
     bool rife_v2;
     bool rife_v4;
     int padding;
+    float scale;
+    int precision[3];
+    float sc_threshold;
+    size_t weight_memory[3];
 };
 
 #endif // RIFE_H
@@ -0,0 +1,418 @@
+// rife implemented with ncnn library
+
+// measures the throughput and latency of RIFE::process over a sweep of models and options, without vapoursynth
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif __APPLE__
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+// ncnn
+#include "benchmark.h"
+#include "cpu.h"
+#include "gpu.h"
+
+#include "rife.h"
+#include "tool_util.h"
+
+// resident memory of the process now, in bytes
+static size_t current_rss()
+{
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.WorkingSetSize;
+#elif __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#else
+    FILE* fp = fopen("/proc/self/statm", "rb");
+    if (!fp)
+        return 0;
+
+    long size = 0;
+    long resident = 0;
+    int n = fscanf(fp, "%ld %ld", &size, &resident);
+    fclose(fp);
+
+    return n == 2 ? (size_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+// the lifetime peak of the process would hide every configuration smaller than an earlier one,
+// so the resident memory is sampled every millisecond and the most since reset is kept
+class RssSampler
+{
+public:
+    RssSampler() : stop(false), peak(current_rss())
+    {
+        thread = std::thread(&RssSampler::sample, this);
+    }
+
+    ~RssSampler()
+    {
+        stop = true;
+        thread.join();
+    }
+
+    void reset()
+    {
+        peak = current_rss();
+    }
+
+    size_t max() const
+    {
+        return std::max(peak.load(), current_rss());
+    }
+
+private:
+    void sample()
+    {
+        while (!stop)
+        {
+            const size_t rss = current_rss();
+            size_t seen = peak.load();
+            while (rss > seen && !peak.compare_exchange_weak(seen, rss))
+            {
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    std::atomic<bool> stop;
+    std::atomic<size_t> peak;
+    std::thread thread;
+};
+
+// frames interpolations spread over threads calling process concurrently, the latency of each call is appended to latencies
+// and the most gpu memory a single call held is stored in memory
+static double run(const RIFE& rife, const Frame& frame0, const Frame& frame1, int threads, int frames, std::vector<double>& latencies, RIFEProfile& memory)
+{
+    const int w = frame0.w;
+    const int h = frame0.h;
+    const size_t plane = (size_t)w * h;
+
+    const float* src0 = frame0.data.data();
+    const float* src1 = frame1.data.data();
+
+    std::atomic<int> next(0);
+    std::vector<std::vector<double> > thread_latencies(threads);
+    std::vector<RIFEProfile> thread_profiles(threads, RIFEProfile());
+
+    const double start = ncnn::get_current_time();
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            std::vector<float> dst(plane * 3);
+
+            while (next++ < frames)
+            {
+                const double call_start = ncnn::get_current_time();
+                rife.process(src0, src0 + plane, src0 + plane * 2, src1, src1 + plane, src1 + plane * 2,
+                             dst.data(), dst.data() + plane, dst.data() + plane * 2, w, h, w, 0.5f, &thread_profiles[t]);
+                thread_latencies[t].push_back(ncnn::get_current_time() - call_start);
+            }
+        });
+    }
+
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+        latencies.insert(latencies.end(), thread_latencies[t].begin(), thread_latencies[t].end());
+        memory.blob_peak = std::max(memory.blob_peak, thread_profiles[t].blob_peak);
+        memory.staging_peak = std::max(memory.staging_peak, thread_profiles[t].staging_peak);
+    }
+
+    return (ncnn::get_current_time() - start) / 1000.0;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    const size_t i = (size_t)std::max(ceil(p * sorted.size()), 1.0) - 1;
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-bench [options] <modeldir> [modeldir...]\n");
+    fprintf(stderr, "  --cpu                  run on the cpu instead of a vulkan device\n");
+    fprintf(stderr, "  --gpu <id>             vulkan device, defaults to the default device\n");
+    fprintf(stderr, "  --cpu-threads <n>      threads of the cpu backend, defaults to the number of big cores\n");
+    fprintf(stderr, "  --size <WxH,...>       sizes of the synthetic frames, defaults to 1920x1080\n");
+    fprintf(stderr, "  --pair <a.ppm> <b.ppm> interpolate between two binary PPM files instead of synthetic frames\n");
+    fprintf(stderr, "  --tta <n,...>          tta variants, defaults to 0\n");
+    fprintf(stderr, "  --uhd <0|1,...>        uhd mode, the same as a scale of 0.5, defaults to 0\n");
+    fprintf(stderr, "  --scale <s,...>        flow scale, defaults to 1\n");
+    fprintf(stderr, "  --precision <p,...>    0 = fp32, 1 = fp16 storage, 2 = fp16 arithmetic, defaults to 1\n");
+    fprintf(stderr, "  --threads <n,...>      concurrent process calls, the gpu_thread of the plugin, defaults to 1\n");
+    fprintf(stderr, "  --frames <n>           interpolations measured per configuration, defaults to 50\n");
+    fprintf(stderr, "  --warmup <n>           interpolations run first and not measured, defaults to 3\n");
+    fprintf(stderr, "The results are written to stdout as a JSON array.\n");
+}
+
+int main(int argc, char** argv)
+{
+    bool cpu = false;
+    int gpuid = -2;
+    int cpu_threads = 0;
+    std::vector<std::string> sizes(1, "1920x1080");
+    const char* pair[2] = { 0, 0 };
+    std::vector<std::string> ttas(1, "0");
+    std::vector<std::string> uhds(1, "0");
+    std::vector<std::string> scales(1, "1");
+    std::vector<std::string> precisions(1, "1");
+    std::vector<std::string> thread_counts(1, "1");
+    int frames = 50;
+    int warmup = 3;
+    std::vector<std::string> modeldirs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--cpu") == 0)
+            cpu = true;
+        else if (strcmp(argv[i], "--gpu") == 0 && has_value)
+            gpuid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cpu-threads") == 0 && has_value)
+            cpu_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && has_value)
+            sizes = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--pair") == 0 && i + 2 < argc)
+        {
+            pair[0] = argv[++i];
+            pair[1] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tta") == 0 && has_value)
+            ttas = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--uhd") == 0 && has_value)
+            uhds = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--scale") == 0 && has_value)
+            scales = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--precision") == 0 && has_value)
+            precisions = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && has_value)
+            thread_counts = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && has_value)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && has_value)
+            warmup = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            print_usage();
+            return -1;
+        }
+        else
+            modeldirs.push_back(argv[i]);
+    }
+
+    if (modeldirs.empty() || frames < 1 || warmup < 0)
+    {
+        print_usage();
+        return -1;
+    }
+
+    // the frame pairs to run on, either the files or one synthetic pair per size
+    std::vector<Frame> frame0s;
+    std::vector<Frame> frame1s;
+    if (pair[0])
+    {
+        Frame frame0;
+        Frame frame1;
+        if (load_ppm(pair[0], frame0) != 0 || load_ppm(pair[1], frame1) != 0)
+            return -1;
+
+        if (frame0.w != frame1.w || frame0.h != frame1.h)
+        {
+            fprintf(stderr, "%s and %s differ in size\n", pair[0], pair[1]);
+            return -1;
+        }
+
+        frame0s.push_back(frame0);
+        frame1s.push_back(frame1);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            int w = 0;
+            int h = 0;
+            if (sscanf(sizes[i].c_str(), "%dx%d", &w, &h) != 2 || w < 1 || h < 1)
+            {
+                fprintf(stderr, "invalid size %s\n", sizes[i].c_str());
+                return -1;
+            }
+
+            Frame frame0;
+            Frame frame1;
+            synthetic_pair(w, h, frame0, frame1);
+            frame0s.push_back(frame0);
+            frame1s.push_back(frame1);
+        }
+    }
+
+    std::string backend = "cpu";
+    if (cpu)
+    {
+        gpuid = -1;
+        if (cpu_threads < 1)
+            cpu_threads = ncnn::get_big_cpu_count();
+    }
+    else
+    {
+        if (ncnn::create_gpu_instance() != 0 || ncnn::get_gpu_count() == 0)
+        {
+            fprintf(stderr, "no vulkan device, use --cpu\n");
+            return -1;
+        }
+
+        if (gpuid == -2)
+            gpuid = ncnn::get_default_gpu_index();
+
+        if (gpuid < 0 || gpuid >= ncnn::get_gpu_count())
+        {
+            fprintf(stderr, "invalid gpu %d\n", gpuid);
+            ncnn::destroy_gpu_instance();
+            return -1;
+        }
+
+        backend = ncnn::get_gpu_info(gpuid).device_name();
+        cpu_threads = 1;
+    }
+
+    int ret = 0;
+    bool first_result = true;
+    RssSampler rss;
+    printf("[");
+
+    for (size_t mi = 0; mi < modeldirs.size() && ret == 0; mi++)
+    {
+        bool rife_v2;
+        bool rife_v4;
+        int model_padding;
+        if (model_type(modeldirs[mi], rife_v2, rife_v4, model_padding) != 0)
+        {
+            fprintf(stderr, "unknown model dir type %s\n", modeldirs[mi].c_str());
+            ret = -1;
+            break;
+        }
+
+        for (size_t ti = 0; ti < ttas.size() && ret == 0; ti++)
+        for (size_t ui = 0; ui < uhds.size() && ret == 0; ui++)
+        for (size_t si = 0; si < scales.size() && ret == 0; si++)
+        for (size_t pi = 0; pi < precisions.size() && ret == 0; pi++)
+        {
+            const int tta = atoi(ttas[ti].c_str());
+            const bool uhd = atoi(uhds[ui].c_str()) != 0;
+            float scale = (float)atof(scales[si].c_str());
+            const int precision = atoi(precisions[pi].c_str());
+
+            if (rife_v4 && tta)
+            {
+                fprintf(stderr, "skipping tta %d, rife-v4 models do not support tta\n", tta);
+                continue;
+            }
+
+            // as in the plugin, uhd is the same as halving the flow resolution
+            if (uhd && scale == 1.f)
+                scale = 0.5f;
+
+            int padding = model_padding;
+            if (scale < 1.f)
+                padding = (int)(padding / scale);
+
+            // what the process held before this configuration, its weights and buffers are counted above it
+            const size_t base_rss = current_rss();
+
+            RIFE rife(gpuid, tta, false, cpu_threads, rife_v2, rife_v4, padding, scale);
+            rife.set_precision(precision, precision, precision);
+
+#if _WIN32
+            const std::wstring modeldir(modeldirs[mi].begin(), modeldirs[mi].end());
+#else
+            const std::string& modeldir = modeldirs[mi];
+#endif
+            const double load_start = ncnn::get_current_time();
+            if (rife.load(modeldir) != 0)
+            {
+                fprintf(stderr, "failed to load %s\n", modeldirs[mi].c_str());
+                ret = -1;
+                break;
+            }
+            const double load_ms = ncnn::get_current_time() - load_start;
+
+            const RIFEMemory weights = rife.memory();
+            const double weights_mb = (weights.flownet + weights.contextnet + weights.fusionnet) / 1048576.0;
+
+            for (size_t fi = 0; fi < frame0s.size(); fi++)
+            {
+                for (size_t ci = 0; ci < thread_counts.size(); ci++)
+                {
+                    const int threads = std::max(atoi(thread_counts[ci].c_str()), 1);
+                    const Frame& frame0 = frame0s[fi];
+                    const Frame& frame1 = frame1s[fi];
+
+                    fprintf(stderr, "%s %dx%d tta %d scale %g precision %d threads %d\n", modeldirs[mi].c_str(), frame0.w, frame0.h,
+                            tta, scale, precision, threads);
+
+                    std::vector<double> latencies;
+                    RIFEProfile memory = RIFEProfile();
+                    rss.reset();
+                    if (warmup > 0)
+                        run(rife, frame0, frame1, threads, warmup * threads, latencies, memory);
+
+                    latencies.clear();
+                    const double seconds = run(rife, frame0, frame1, threads, frames, latencies, memory);
+                    std::sort(latencies.begin(), latencies.end());
+
+                    const size_t peak_rss = rss.max();
+                    const double peak_rss_mb = peak_rss > base_rss ? (peak_rss - base_rss) / 1048576.0 : 0.0;
+
+                    printf("%s\n  {\"model\": %s, \"backend\": %s, \"width\": %d, \"height\": %d, \"tta\": %d, \"uhd\": %s, \"scale\": %g, "
+                           "\"precision\": %d, \"threads\": %d, \"frames\": %d, \"load_ms\": %.3f, \"seconds\": %.3f, \"fps\": %.3f, "
+                           "\"latency_p50_ms\": %.3f, \"latency_p99_ms\": %.3f, \"latency_max_ms\": %.3f, \"peak_rss_mb\": %.1f, "
+                           "\"blob_peak_mb\": %.1f, \"staging_peak_mb\": %.1f, \"weights_mb\": %.1f}",
+                           first_result ? "" : ",", json_string(modeldirs[mi]).c_str(), json_string(backend).c_str(), frame0.w, frame0.h,
+                           tta, uhd ? "true" : "false", scale, precision, threads, frames, load_ms, seconds, frames / seconds,
+                           percentile(latencies, 0.5), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back(), peak_rss_mb,
+                           memory.blob_peak / 1048576.0, memory.staging_peak / 1048576.0, weights_mb);
+                    fflush(stdout);
+
+                    first_result = false;
+                }
+            }
+        }
+    }
+
+    printf("\n]\n");
+
+    if (!cpu)
+        ncnn::destroy_gpu_instance();
+
+    return ret;
+}
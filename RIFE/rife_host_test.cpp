@@ -0,0 +1,575 @@
+// rife implemented with ncnn library
+
+// checks of the host code that need neither model weights nor a gpu: the param rewrites on the params in models,
+// the frame codec of disk_cache and the frame comparisons, run by meson test
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "compare.h"
+#include "frame_codec.h"
+#include "param_graph.h"
+#include "tool_util.h"
+
+static int failures = 0;
+
+// warp pairs fused over all params, printed so that a rewrite that stops matching shows up
+static int fused_pairs = 0;
+
+// what is being checked, printed with each failure
+static std::string context;
+
+#define CHECK(cond)                                                                                                \
+    do                                                                                                             \
+    {                                                                                                              \
+        if (!(cond))                                                                                               \
+        {                                                                                                          \
+            fprintf(stderr, "%s: line %d: %s failed\n", context.c_str(), __LINE__, #cond);                      \
+            failures++;                                                                                            \
+        }                                                                                                          \
+    } while (0)
+
+static int read_file(const std::string& path, std::string& text)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return -1;
+
+    char buf[4096];
+    size_t nread;
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        text.append(buf, nread);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int count_layers(const ParamGraph& graph, const char* type)
+{
+    int count = 0;
+    for (size_t i = 0; i < graph.layers.size(); i++)
+    {
+        if (graph.layers[i].type == type)
+            count++;
+    }
+
+    return count;
+}
+
+// every blob is produced once and before it is read, by at most one layer since ncnn fans out through Split layers,
+// and the text of the graph reads back to the same graph
+static bool valid_graph(const ParamGraph& graph)
+{
+    std::set<std::string> produced;
+    std::set<std::string> consumed;
+
+    for (size_t i = 0; i < graph.layers.size(); i++)
+    {
+        const ParamGraph::Layer& layer = graph.layers[i];
+
+        for (size_t j = 0; j < layer.bottoms.size(); j++)
+        {
+            if (!produced.count(layer.bottoms[j]) || !consumed.insert(layer.bottoms[j]).second)
+                return false;
+        }
+
+        for (size_t j = 0; j < layer.tops.size(); j++)
+        {
+            if (!produced.insert(layer.tops[j]).second)
+                return false;
+        }
+    }
+
+    ParamGraph reparsed;
+    return reparsed.parse(graph.str().c_str()) == 0 && reparsed.str() == graph.str();
+}
+
+// interp scale params of every layer, to tell whether rescale_flownet changed them
+static std::vector<std::string> interp_scales(const ParamGraph& graph)
+{
+    std::vector<std::string> scales;
+    for (size_t i = 0; i < graph.layers.size(); i++)
+    {
+        if (graph.layers[i].type != "Interp")
+            continue;
+
+        const char* height_scale = ParamGraph::get_param(graph.layers[i], 1);
+        const char* width_scale = ParamGraph::get_param(graph.layers[i], 2);
+        scales.push_back(std::string(height_scale ? height_scale : "") + "," + (width_scale ? width_scale : ""));
+    }
+
+    return scales;
+}
+
+// the warp pairs fused as in rife load_param_edited, on a graph that is otherwise already edited
+static void check_fuse(ParamGraph graph)
+{
+    const int warps = count_layers(graph, "rife.Warp");
+    const int warp2s = count_layers(graph, "rife.Warp2");
+
+    const int pairs = fuse_warp_pairs(graph);
+    CHECK(pairs >= 0);
+    fused_pairs += pairs;
+    CHECK(count_layers(graph, "rife.Warp") == warps - pairs * 2);
+    CHECK(count_layers(graph, "rife.Warp2") == warp2s + pairs);
+    CHECK(valid_graph(graph));
+
+    // nothing is left to fuse
+    CHECK(fuse_warp_pairs(graph) == 0);
+}
+
+static void test_param_graph(const std::string& modelsdir)
+{
+    std::vector<std::string> modeldirs;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(modelsdir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+    {
+        if (std::filesystem::exists(it->path() / "flownet.param"))
+            modeldirs.push_back(it->path().string());
+    }
+    std::sort(modeldirs.begin(), modeldirs.end());
+
+    context = modelsdir;
+    CHECK(!modeldirs.empty());
+
+    static const char* const nets[] = {"flownet", "contextnet", "fusionnet"};
+
+    for (size_t i = 0; i < modeldirs.size(); i++)
+    {
+        bool rife_v2;
+        bool rife_v4;
+        int padding;
+        context = modeldirs[i];
+        CHECK(model_type(modeldirs[i], rife_v2, rife_v4, padding) == 0);
+
+        for (int n = 0; n < 3; n++)
+        {
+            std::string text;
+            if (read_file(modeldirs[i] + "/" + nets[n] + ".param", text) != 0)
+                continue;
+
+            context = modeldirs[i] + "/" + nets[n] + ".param";
+
+            ParamGraph graph;
+            CHECK(graph.parse(text.c_str()) == 0);
+            CHECK(valid_graph(graph));
+
+            if (n != 0 || !rife_v4)
+            {
+                check_fuse(graph);
+                continue;
+            }
+
+            // in the order of load_param_edited, for every scale the plugin accepts
+            static const float scales[] = {0.25f, 0.5f, 1.f, 2.f};
+            for (int s = 0; s < 4; s++)
+            {
+                ParamGraph edited = graph;
+                context = modeldirs[i] + "/flownet.param at scale " + std::to_string(scales[s]);
+
+                if (scales[s] != 1.f)
+                {
+                    CHECK(rescale_flownet(edited, scales[s]) == 0);
+                    CHECK(valid_graph(edited));
+                    CHECK(interp_scales(edited) != interp_scales(graph));
+                    CHECK(edited.layers.size() > graph.layers.size());
+                }
+
+                // the BinaryOp readers of the timestep keep it, the others share a single plane built from it
+                int scalar_readers = 0;
+                int plane_readers = 0;
+                std::vector<int> readers = edited.consumers("in2");
+                for (size_t r = 0; r < readers.size(); r++)
+                {
+                    if (edited.layers[readers[r]].type == "BinaryOp" && edited.layers[readers[r]].bottoms.size() == 2)
+                        scalar_readers++;
+                    else
+                        plane_readers++;
+                }
+
+                const std::string before = edited.str();
+                CHECK(broadcast_timestep(edited, "in2", "in0") == 0);
+                CHECK(valid_graph(edited));
+                CHECK(plane_readers || edited.str() == before);
+
+                readers = edited.consumers("in2");
+                CHECK((int)readers.size() == scalar_readers + (plane_readers ? 1 : 0));
+                for (size_t r = 0; r < readers.size(); r++)
+                {
+                    CHECK(edited.layers[readers[r]].type == "BinaryOp" && edited.layers[readers[r]].bottoms.size() == 2);
+                }
+
+                check_fuse(edited);
+            }
+        }
+    }
+
+    fprintf(stdout, "%d model dirs, %d warp pairs fused\n", (int)modeldirs.size(), fused_pairs);
+}
+
+// planar frame with a padded stride, the values of the padding are set to pad
+struct PaddedFrame
+{
+    int w;
+    int h;
+    ptrdiff_t stride;
+    std::vector<float> data;
+
+    PaddedFrame(int _w, int _h, float pad)
+        : w(_w), h(_h), stride(_w + 5), data((size_t)(_w + 5) * _h * 3, pad)
+    {
+    }
+
+    float* plane(int p)
+    {
+        return data.data() + stride * h * p;
+    }
+
+    float& at(int p, int x, int y)
+    {
+        return plane(p)[stride * y + x];
+    }
+
+    void planes(const float* out[3])
+    {
+        for (int p = 0; p < 3; p++)
+            out[p] = plane(p);
+    }
+
+    void planes(float* out[3])
+    {
+        for (int p = 0; p < 3; p++)
+            out[p] = plane(p);
+    }
+
+    void fill(float v)
+    {
+        for (int p = 0; p < 3; p++)
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                    at(p, x, y) = v;
+    }
+};
+
+static bool same_pixels(PaddedFrame& a, PaddedFrame& b)
+{
+    for (int p = 0; p < 3; p++)
+    {
+        for (int y = 0; y < a.h; y++)
+        {
+            if (memcmp(&a.at(p, 0, y), &b.at(p, 0, y), sizeof(float) * a.w) != 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void test_frame_codec()
+{
+    static const int sizes[][2] = {{1, 1}, {3, 2}, {37, 23}, {256, 144}};
+
+    for (int s = 0; s < 4; s++)
+    {
+        const int w = sizes[s][0];
+        const int h = sizes[s][1];
+        context = "frame_codec " + std::to_string(w) + "x" + std::to_string(h);
+
+        // smooth gradients, noise, and values the predictor has no use for
+        PaddedFrame frame(w, h, 1234.5f);
+        unsigned int seed = 1;
+        for (int p = 0; p < 3; p++)
+        {
+            for (int y = 0; y < h; y++)
+            {
+                for (int x = 0; x < w; x++)
+                {
+                    seed = seed * 1664525 + 1013904223;
+                    float v = (float)(x + y * 2) / (w + h * 2) + (p == 1 ? (seed >> 8) / 16777216.f * 0.1f : 0.f);
+                    if ((x + y) % 17 == 16)
+                        v = -v;
+                    if (x == 3 && y == 1)
+                        v = -0.f;
+                    if (x == 5 && y == 1)
+                        v = 1e30f;
+                    if (x == 7 && y == 1)
+                        v = 1e-40f;
+                    frame.at(p, x, y) = v;
+                }
+            }
+        }
+
+        const float* src[3];
+        frame.planes(src);
+        std::vector<unsigned char> data = compressFrame(src, w, h, frame.stride);
+
+        PaddedFrame out(w, h, -1.f);
+        float* dst[3];
+        out.planes(dst);
+        CHECK(decompressFrame(data.data(), data.size(), dst, w, h, out.stride));
+        CHECK(same_pixels(frame, out));
+
+        // anything but the whole stream of a frame of this size is rejected
+        CHECK(!decompressFrame(data.data(), data.size() - 1, dst, w, h, out.stride));
+        data.push_back(0);
+        CHECK(!decompressFrame(data.data(), data.size(), dst, w, h, out.stride));
+        data.pop_back();
+        CHECK(!decompressFrame(data.data(), data.size(), dst, w + 1, h, out.stride));
+        CHECK(!decompressFrame(data.data(), data.size(), dst, w, h + 1, out.stride));
+        data[0] ^= 1;
+        CHECK(!decompressFrame(data.data(), data.size(), dst, w, h, out.stride));
+
+        // a black frame is predicted exactly, leaving the 16 byte header and a code byte for every 4 values
+        PaddedFrame black(w, h, 7.f);
+        black.fill(0.f);
+        black.planes(src);
+        CHECK(compressFrame(src, w, h, black.stride).size() == 16 + ((size_t)w * h * 3 + 3) / 4);
+    }
+}
+
+static void test_compare()
+{
+    const int w = 256;
+    const int h = 192;
+
+    PaddedFrame frame0(w, h, 0.f);
+    PaddedFrame frame1(w, h, 0.f);
+    for (int p = 0; p < 3; p++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                frame0.at(p, x, y) = (float)((x * 7 + y * 3 + p * 11) % 64) / 128.f + 0.25f;
+                frame1.at(p, x, y) = frame0.at(p, x, y);
+            }
+        }
+    }
+
+    const float* src0[3];
+    const float* src1[3];
+    frame0.planes(src0);
+    frame1.planes(src1);
+
+    context = "framePSNR";
+    CHECK(framePSNR(src0, src1, w, h, frame0.stride) == 60.0);
+
+    // the luma weights sum to 1, so a difference of d in every channel is 20 log10(1 / d)
+    static const int psnr_sizes[][2] = {{256, 192}, {1100, 600}};
+    for (int s = 0; s < 2; s++)
+    {
+        PaddedFrame a(psnr_sizes[s][0], psnr_sizes[s][1], 0.f);
+        PaddedFrame b(psnr_sizes[s][0], psnr_sizes[s][1], 0.f);
+        a.fill(0.5f);
+        b.fill(0.51f);
+
+        const float* pa[3];
+        const float* pb[3];
+        a.planes(pa);
+        b.planes(pb);
+        CHECK(fabs(framePSNR(pa, pb, a.w, a.h, a.stride) - 40.0) < 0.01);
+    }
+
+    context = "frameHash";
+    const uint64_t hash = frameHash(src0, w, h, frame0.stride);
+    CHECK(hash == frameHash(src1, w, h, frame1.stride));
+
+    // the padding is not part of the frame
+    PaddedFrame padded(w, h, 99.f);
+    for (int p = 0; p < 3; p++)
+        for (int y = 0; y < h; y++)
+            memcpy(&padded.at(p, 0, y), &frame0.at(p, 0, y), sizeof(float) * w);
+    const float* src2[3];
+    padded.planes(src2);
+    CHECK(frameHash(src2, w, h, padded.stride) == hash);
+
+    // the same on every build, the sse2 and the scalar path included, so that disk_cache entries are shared
+    // a width of 253 also takes the 8 and 4 byte tails of each row
+    CHECK(hash == 0x2b74e50aad5efc0dULL);
+    CHECK(frameHash(src0, 253, h, frame0.stride) == 0x12579722361189a8ULL);
+
+    // a single value, in any plane, changes it, so does the size
+    CHECK(frameHash(src0, w - 1, h, frame0.stride) != hash);
+    for (int p = 0; p < 3; p++)
+    {
+        frame1.at(p, 255, 191) += 1.f / 1024;
+        CHECK(frameHash(src1, w, h, frame1.stride) != hash);
+        frame1.at(p, 255, 191) = frame0.at(p, 255, 191);
+    }
+
+    context = "sampledMaxDiff";
+    frame1.at(1, 10, 1) += 0.5f;
+    CHECK(sampledMaxDiff(src0, src1, w, h, frame0.stride) == 0.f);
+    frame1.at(1, 10, 4) += 0.25f;
+    CHECK(sampledMaxDiff(src0, src1, w, h, frame0.stride) == 0.25f);
+    frame1.at(1, 10, 1) = frame0.at(1, 10, 1);
+    frame1.at(1, 10, 4) = frame0.at(1, 10, 4);
+
+    context = "dirtyRegions";
+    CHECK(dirtyRegions(src0, src1, w, h, frame0.stride, 0.01f, 16).empty());
+
+    // blocks of 32x32, the outer rect adds the margin within the frame
+    frame1.at(1, 100, 70) += 0.5f;
+    frame1.at(2, 200, 10) += 0.5f;
+    frame1.at(0, 50, 150) += 0.005f;
+    std::vector<DirtyRegion> regions = dirtyRegions(src0, src1, w, h, frame0.stride, 0.01f, 16);
+    CHECK(regions.size() == 2);
+    if (regions.size() == 2)
+    {
+        CHECK(regions[0].inner.x == 192 && regions[0].inner.y == 0 && regions[0].inner.width == 32 && regions[0].inner.height == 32);
+        CHECK(regions[0].outer.x == 176 && regions[0].outer.y == 0 && regions[0].outer.width == 64 && regions[0].outer.height == 48);
+        CHECK(regions[1].inner.x == 96 && regions[1].inner.y == 64 && regions[1].inner.width == 32 && regions[1].inner.height == 32);
+        CHECK(regions[1].outer.x == 80 && regions[1].outer.y == 48 && regions[1].outer.width == 64 && regions[1].outer.height == 64);
+    }
+
+    // within the margin of each other they are one region
+    regions = dirtyRegions(src0, src1, w, h, frame0.stride, 0.01f, 64);
+    CHECK(regions.size() == 1);
+    if (regions.size() == 1)
+    {
+        CHECK(regions[0].inner.x == 96 && regions[0].inner.y == 0 && regions[0].inner.width == 128 && regions[0].inner.height == 96);
+        CHECK(regions[0].outer.x == 32 && regions[0].outer.y == 0 && regions[0].outer.width == 224 && regions[0].outer.height == 160);
+    }
+
+    // the last blocks of a frame that is not a multiple of 32 are cut to it
+    frame1.at(0, 249, 191) += 0.5f;
+    regions = dirtyRegions(src0, src1, 250, h, frame0.stride, 0.01f, 0);
+    CHECK(regions.size() == 3);
+    if (regions.size() == 3)
+        CHECK(regions[2].inner.x == 224 && regions[2].inner.y == 160 && regions[2].inner.width == 26 && regions[2].inner.height == 32);
+
+    context = "activeArea";
+    PaddedFrame letterbox(160, 120, 1.f);
+    letterbox.fill(0.02f);
+    for (int p = 0; p < 3; p++)
+        for (int y = 12; y < 108; y++)
+            for (int x = 20; x < 140; x++)
+                letterbox.at(p, x, y) = 0.5f;
+
+    const float* src3[3];
+    letterbox.planes(src3);
+    Rect area = activeArea(src3, 160, 120, letterbox.stride, 0.03f);
+    CHECK(area.x == 20 && area.y == 12 && area.width == 120 && area.height == 96);
+
+    // nothing above the threshold is all border
+    area = activeArea(src3, 160, 120, letterbox.stride, 0.5f);
+    CHECK(area.x == 0 && area.y == 0 && area.width == 0 && area.height == 0);
+
+    // a single bright value in a row widens the area to it
+    letterbox.at(2, 5, 60) = 0.5f;
+    area = activeArea(src3, 160, 120, letterbox.stride, 0.03f);
+    CHECK(area.x == 5 && area.y == 12 && area.width == 135 && area.height == 96);
+
+    context = "sceneChangeBlocks";
+    PaddedFrame still(w, h, 0.f);
+    PaddedFrame moved(w, h, 0.f);
+    for (int p = 0; p < 3; p++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                still.at(p, x, y) = frame0.at(p, x, y);
+                moved.at(p, x, y) = frame0.at(p, x, y);
+            }
+        }
+    }
+
+    const float* src4[3];
+    const float* src5[3];
+    still.planes(src4);
+    moved.planes(src5);
+    CHECK(sceneChangeBlocks(src4, src5, w, h, still.stride, 0.1f) == 0.f);
+
+    // a square moving by its size changes few blocks of the whole frame, but most blocks of its own dirty region,
+    // which is why the plugin tests the whole frame before the regions
+    for (int p = 0; p < 3; p++)
+    {
+        for (int y = 64; y < 96; y++)
+        {
+            for (int x = 64; x < 96; x++)
+            {
+                still.at(p, x, y) = 1.f;
+                moved.at(p, x + 32, y) = 1.f;
+            }
+        }
+    }
+
+    CHECK(sceneChangeBlocks(src4, src5, w, h, still.stride, 0.1f) < 0.1f);
+
+    regions = dirtyRegions(src4, src5, w, h, still.stride, 0.01f, 1);
+    CHECK(regions.size() == 1);
+    if (regions.size() == 1)
+    {
+        const Rect& outer = regions[0].outer;
+        const float* region4[3];
+        const float* region5[3];
+        for (int p = 0; p < 3; p++)
+        {
+            region4[p] = src4[p] + outer.y * still.stride + outer.x;
+            region5[p] = src5[p] + outer.y * moved.stride + outer.x;
+        }
+        CHECK(sceneChangeBlocks(region4, region5, outer.width, outer.height, still.stride, 0.1f) > 0.5f);
+    }
+
+    // a pan of a fine texture changes every pixel but no block mean, the samples 4 apart are half a period apart
+    for (int p = 0; p < 3; p++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                still.at(p, x, y) = 0.5f + 0.4f * (float)sin(x * 3.14159265 / 4);
+                moved.at(p, x, y) = 0.5f + 0.4f * (float)sin((x + 2) * 3.14159265 / 4);
+            }
+        }
+    }
+    CHECK(sceneChangeBlocks(src4, src5, w, h, still.stride, 0.1f) == 0.f);
+
+    // a cut to another picture changes most of them
+    for (int p = 0; p < 3; p++)
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                moved.at(p, x, y) = (float)x / w;
+    CHECK(sceneChangeBlocks(src4, src5, w, h, still.stride, 0.1f) > 0.5f);
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-host-test <test>\n");
+    fprintf(stderr, "  --param-graph <modelsdir>   param rewrites on the params of every model dir in modelsdir\n");
+    fprintf(stderr, "  --frame-codec               frame codec round trips\n");
+    fprintf(stderr, "  --compare                   known answers of the frame comparisons\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--param-graph") == 0)
+        test_param_graph(argv[2]);
+    else if (argc == 2 && strcmp(argv[1], "--frame-codec") == 0)
+        test_frame_codec();
+    else if (argc == 2 && strcmp(argv[1], "--compare") == 0)
+        test_compare();
+    else
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -24,4 +24,21 @@ private:
     ncnn::Pipeline* pipeline_warp_pack8;
 };
 
+// two Warp layers sharing one flow, image0 is warped by flow channels 0 and 1 and image1 by channels 2 and 3
+// both images must have the same shape, see fuse_warp_pairs
+class Warp2 : public ncnn::Layer
+{
+public:
+    Warp2();
+    virtual int create_pipeline(const ncnn::Option& opt);
+    virtual int destroy_pipeline(const ncnn::Option& opt);
+    virtual int forward(const std::vector<ncnn::Mat>& bottom_blobs, std::vector<ncnn::Mat>& top_blobs, const ncnn::Option& opt) const;
+    virtual int forward(const std::vector<ncnn::VkMat>& bottom_blobs, std::vector<ncnn::VkMat>& top_blobs, ncnn::VkCompute& cmd, const ncnn::Option& opt) const;
+
+private:
+    ncnn::Pipeline* pipeline_warp2;
+    ncnn::Pipeline* pipeline_warp2_pack4;
+    ncnn::Pipeline* pipeline_warp2_pack8;
+};
+
 #endif // RIFE_OPS_H
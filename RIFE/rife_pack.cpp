@@ -0,0 +1,158 @@
+// rife implemented with ncnn library
+
+// builds MODEL_PACK_NAME from the flownet/contextnet/fusionnet param and bin files of a model directory
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "model_pack.h"
+#include "rife_ops.h"
+
+DEFINE_LAYER_CREATOR(Warp)
+
+static int read_file(const std::string& path, std::vector<unsigned char>& data)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data.resize(size < 0 ? 0 : size);
+    size_t nread = fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+
+    return nread == data.size() ? 0 : -1;
+}
+
+static int pack_net(const std::string& modeldir, const char* name, bool fp16, std::vector<ModelPackEntry>& entries)
+{
+    const std::string parampath = modeldir + "/" + name + ".param";
+    const std::string modelpath = modeldir + "/" + name + ".bin";
+
+    std::vector<unsigned char> param;
+    if (read_file(parampath, param) != 0)
+        return 0;
+
+    ModelPackEntry entry;
+    entry.name = name;
+    entry.flags = 0;
+    entry.param.assign(param.begin(), param.end());
+
+    if (fp16)
+    {
+        ncnn::Net net;
+        ncnn::Net check_net;
+        net.register_custom_layer("rife.Warp", Warp_layer_creator);
+        check_net.register_custom_layer("rife.Warp", Warp_layer_creator);
+
+        FILE* fp = fopen(modelpath.c_str(), "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", modelpath.c_str());
+            return -1;
+        }
+
+        int ret = -1;
+        if (net.load_param_mem(entry.param.c_str()) == 0 && check_net.load_param_mem(entry.param.c_str()) == 0)
+            ret = convert_model_fp16(net, check_net, fp, entry.model);
+
+        fclose(fp);
+
+        if (ret == 0)
+            entry.flags |= MODEL_PACK_ENTRY_FP16_WEIGHTS;
+        else
+            fprintf(stderr, "%s weights could not be converted to fp16, keeping fp32\n", name);
+    }
+
+    if (!(entry.flags & MODEL_PACK_ENTRY_FP16_WEIGHTS))
+    {
+        if (read_file(modelpath, entry.model) != 0)
+        {
+            fprintf(stderr, "read %s failed\n", modelpath.c_str());
+            return -1;
+        }
+    }
+
+    fprintf(stderr, "%s: param %d bytes, weights %d bytes%s\n", name, (int)entry.param.size(), (int)entry.model.size(),
+            entry.flags & MODEL_PACK_ENTRY_FP16_WEIGHTS ? " (fp16)" : "");
+
+    entries.push_back(entry);
+
+    return 0;
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-pack [--fp32] <modeldir> [output]\n");
+    fprintf(stderr, "  --fp32     keep the weights in fp32, for devices without fp16 storage\n");
+    fprintf(stderr, "  output     defaults to <modeldir>/" MODEL_PACK_NAME "\n");
+}
+
+int main(int argc, char** argv)
+{
+    bool fp16 = true;
+    std::string modeldir;
+    std::string outpath;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fp32") == 0)
+            fp16 = false;
+        else if (modeldir.empty())
+            modeldir = argv[i];
+        else if (outpath.empty())
+            outpath = argv[i];
+        else
+        {
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (modeldir.empty())
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (outpath.empty())
+        outpath = modeldir + "/" MODEL_PACK_NAME;
+
+    std::vector<ModelPackEntry> entries;
+    if (pack_net(modeldir, "flownet", fp16, entries) != 0
+            || pack_net(modeldir, "contextnet", fp16, entries) != 0
+            || pack_net(modeldir, "fusionnet", fp16, entries) != 0)
+        return -1;
+
+    if (entries.empty() || entries[0].name != "flownet")
+    {
+        fprintf(stderr, "%s/flownet.param not found\n", modeldir.c_str());
+        return -1;
+    }
+
+    FILE* fp = fopen(outpath.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", outpath.c_str());
+        return -1;
+    }
+
+    int ret = save_model_pack(fp, fp16 ? MODEL_PACK_FP16_STORAGE : 0, entries);
+    fclose(fp);
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "write %s failed\n", outpath.c_str());
+        remove(outpath.c_str());
+        return -1;
+    }
+
+    fprintf(stderr, "wrote %s with ncnn %s\n", outpath.c_str(), NCNN_VERSION_STRING);
+
+    return 0;
+}
@@ -0,0 +1,441 @@
+// rife implemented with ncnn library
+
+// measures the memory throughput of the hand-written shaders on synthetic tensors, without the networks,
+// against the bandwidth of a plain buffer copy on the same device
+
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// ncnn
+#include "benchmark.h"
+#include "command.h"
+#include "gpu.h"
+
+#include "rife_ops.h"
+#include "tool_util.h"
+
+#include "rife_preproc.comp.hex.h"
+#include "rife_postproc.comp.hex.h"
+#include "rife_flow_tta_avg.comp.hex.h"
+
+// one kernel on one set of tensors
+struct Dispatch
+{
+    const char* kernel;
+    int channels;
+    int elempack;
+    // read and written by one dispatch
+    size_t bytes;
+    std::function<void()> record;
+};
+
+// fastest of repeats measurements in milliseconds per dispatch, each recording runs dispatches and submitting them at once
+static double measure(ncnn::VkCompute& cmd, const std::function<void()>& record, int runs, int repeats)
+{
+    double best = 0.0;
+    for (int r = 0; r < repeats; r++)
+    {
+        for (int i = 0; i < runs; i++)
+            record();
+
+        const double start = ncnn::get_current_time();
+        cmd.submit_and_wait();
+        const double ms = (ncnn::get_current_time() - start) / runs;
+        cmd.reset();
+
+        if (r == 0 || ms < best)
+            best = ms;
+    }
+
+    return best;
+}
+
+static ncnn::Pipeline* create_pipeline(const ncnn::VulkanDevice* vkdev, const char* comp_data, int comp_data_size, const ncnn::Option& opt, int local_c)
+{
+    std::vector<uint32_t> spirv;
+    if (ncnn::compile_spirv_module(comp_data, comp_data_size, opt, spirv) != 0)
+        return 0;
+
+    // the bgr flag of preproc and postproc, ignored by the others
+    std::vector<ncnn::vk_specialization_type> specializations(1);
+    specializations[0].i = 0;
+
+    ncnn::Pipeline* pipeline = new ncnn::Pipeline(vkdev);
+    pipeline->set_optimal_local_size_xyz(8, 8, local_c);
+    pipeline->create(spirv.data(), spirv.size() * 4, specializations);
+    return pipeline;
+}
+
+// fp32 values in 0..range, written in elempack order, the same for every call
+static ncnn::Mat synthetic_mat(int w, int h, int c, int elempack, float range)
+{
+    ncnn::Mat m(w, h, c, (size_t)4u * elempack, elempack);
+
+    unsigned int seed = 1;
+    for (int q = 0; q < m.c; q++)
+    {
+        float* ptr = m.channel(q);
+        for (int i = 0; i < w * h * elempack; i++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            ptr[i] = (seed >> 8) * (range / 16777216.f);
+        }
+    }
+
+    return m;
+}
+
+static bool wanted(const std::vector<std::string>& kernels, const char* name)
+{
+    if (kernels.empty())
+        return true;
+
+    for (size_t i = 0; i < kernels.size(); i++)
+    {
+        if (kernels[i] == name)
+            return true;
+    }
+
+    return false;
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-shader-bench [options]\n");
+    fprintf(stderr, "  --gpu <id>             vulkan device, defaults to the default device\n");
+    fprintf(stderr, "  --size <WxH,...>       sizes of the synthetic tensors, defaults to 1920x1080,3840x2160\n");
+    fprintf(stderr, "  --channels <n>         channels of the warped feature maps, defaults to 32\n");
+    fprintf(stderr, "  --precision <p,...>    0 = fp32, 1 = fp16 storage, defaults to 1\n");
+    fprintf(stderr, "  --kernel <name,...>    preproc, postproc, flow_tta_avg, warp, warp2, defaults to all\n");
+    fprintf(stderr, "  --runs <n>             dispatches submitted at once, defaults to 20\n");
+    fprintf(stderr, "  --repeats <n>          submissions, the fastest is kept, defaults to 5\n");
+    fprintf(stderr, "  --copy-mb <n>          size of the buffer copy the bandwidth is measured with, defaults to 256\n");
+    fprintf(stderr, "The results are written to stdout as a JSON array, bytes count every element read and written once.\n");
+}
+
+int main(int argc, char** argv)
+{
+    int gpuid = -1;
+    std::vector<std::string> sizes;
+    sizes.push_back("1920x1080");
+    sizes.push_back("3840x2160");
+    int channels = 32;
+    std::vector<std::string> precisions(1, "1");
+    std::vector<std::string> kernels;
+    int runs = 20;
+    int repeats = 5;
+    int copy_mb = 256;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--gpu") == 0 && has_value)
+            gpuid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && has_value)
+            sizes = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--channels") == 0 && has_value)
+            channels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--precision") == 0 && has_value)
+            precisions = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--kernel") == 0 && has_value)
+            kernels = split_list(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && has_value)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--repeats") == 0 && has_value)
+            repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--copy-mb") == 0 && has_value)
+            copy_mb = atoi(argv[++i]);
+        else
+        {
+            print_usage();
+            return -1;
+        }
+    }
+
+    // the warped feature maps are split into channels / elempack packs
+    if (channels < 8 || channels % 8 != 0 || runs < 1 || repeats < 1 || copy_mb < 1)
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (ncnn::create_gpu_instance() != 0 || ncnn::get_gpu_count() == 0)
+    {
+        fprintf(stderr, "no vulkan device\n");
+        return -1;
+    }
+
+    if (gpuid == -1)
+        gpuid = ncnn::get_default_gpu_index();
+
+    if (gpuid < 0 || gpuid >= ncnn::get_gpu_count())
+    {
+        fprintf(stderr, "invalid gpu %d\n", gpuid);
+        ncnn::destroy_gpu_instance();
+        return -1;
+    }
+
+    const ncnn::VulkanDevice* vkdev = ncnn::get_gpu_device(gpuid);
+    const std::string device = json_string(ncnn::get_gpu_info(gpuid).device_name());
+
+    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
+    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+
+    int ret = 0;
+    bool first_result = true;
+    printf("[");
+
+    // the reference, a device to device copy reads and writes every byte once
+    double copy_gbps = 0.0;
+    {
+        ncnn::Option opt;
+        opt.blob_vkallocator = blob_vkallocator;
+        opt.workspace_vkallocator = blob_vkallocator;
+        opt.staging_vkallocator = staging_vkallocator;
+
+        ncnn::VkMat src;
+        src.create(copy_mb * 1048576 / 4, (size_t)4u, blob_vkallocator);
+
+        ncnn::VkCompute cmd(vkdev);
+        ncnn::VkMat dst;
+        const double ms = measure(cmd, [&]() { cmd.record_clone(src, dst, opt); }, runs, repeats);
+
+        const double mb = copy_mb * 2.0;
+        copy_gbps = mb / 1024.0 / ms * 1000.0;
+
+        printf("\n  {\"device\": %s, \"kernel\": \"copy\", \"mb\": %.1f, \"ms\": %.4f, \"gbps\": %.2f}", device.c_str(), mb, ms, copy_gbps);
+        first_result = false;
+    }
+
+    for (size_t pi = 0; pi < precisions.size() && ret == 0; pi++)
+    {
+        ncnn::Option opt;
+        opt.use_vulkan_compute = true;
+        opt.use_fp16_packed = atoi(precisions[pi].c_str()) != 0 && vkdev->info.support_fp16_storage();
+        opt.use_fp16_storage = opt.use_fp16_packed;
+        opt.use_fp16_arithmetic = false;
+        opt.use_int8_storage = false;
+        opt.use_shader_pack8 = true;
+        opt.blob_vkallocator = blob_vkallocator;
+        opt.workspace_vkallocator = blob_vkallocator;
+        opt.staging_vkallocator = staging_vkallocator;
+
+        const int precision = opt.use_fp16_storage ? 1 : 0;
+        const size_t es = opt.use_fp16_storage ? 2u : 4u;
+
+        ncnn::Pipeline* preproc = create_pipeline(vkdev, rife_preproc_comp_data, sizeof(rife_preproc_comp_data), opt, 3);
+        ncnn::Pipeline* postproc = create_pipeline(vkdev, rife_postproc_comp_data, sizeof(rife_postproc_comp_data), opt, 3);
+        ncnn::Pipeline* flow_tta_avg = create_pipeline(vkdev, rife_flow_tta_avg_comp_data, sizeof(rife_flow_tta_avg_comp_data), opt, 1);
+
+        Warp warp;
+        warp.vkdev = vkdev;
+        warp.create_pipeline(opt);
+
+        Warp2 warp2;
+        warp2.vkdev = vkdev;
+        warp2.create_pipeline(opt);
+
+        if (!preproc || !postproc || !flow_tta_avg)
+        {
+            fprintf(stderr, "failed to compile the shaders\n");
+            ret = -1;
+        }
+
+        for (size_t si = 0; si < sizes.size() && ret == 0; si++)
+        {
+            int w = 0;
+            int h = 0;
+            if (sscanf(sizes[si].c_str(), "%dx%d", &w, &h) != 2 || w < 1 || h < 1)
+            {
+                fprintf(stderr, "invalid size %s\n", sizes[si].c_str());
+                ret = -1;
+                break;
+            }
+
+            // the padding of most models
+            const int w_padded = (w + 31) / 32 * 32;
+            const int h_padded = (h + 31) / 32 * 32;
+
+            ncnn::VkCompute cmd(vkdev);
+
+            std::vector<Dispatch> dispatches;
+
+            // the fp32 frame is uploaded as it is, the rest in the storage precision
+            ncnn::VkMat frame_gpu;
+            ncnn::VkMat frame_padded_gpu;
+            ncnn::VkMat frame_out_gpu;
+            if (wanted(kernels, "preproc") || wanted(kernels, "postproc"))
+            {
+                cmd.record_clone(synthetic_mat(w, h, 3, 1, 255.f), frame_gpu, opt);
+                cmd.record_upload(synthetic_mat(w_padded, h_padded, 3, 1, 255.f), frame_padded_gpu, opt);
+                frame_out_gpu.create(w, h, 3, (size_t)4u, 1, blob_vkallocator);
+            }
+
+            ncnn::VkMat preproc_out_gpu;
+            if (wanted(kernels, "preproc"))
+            {
+                preproc_out_gpu.create(w_padded, h_padded, 3, es, 1, blob_vkallocator);
+
+                Dispatch d = { "preproc", 3, 1, (size_t)w * h * 3 * 4 + (size_t)w_padded * h_padded * 3 * es, 0 };
+                d.record = [&]() {
+                    std::vector<ncnn::VkMat> bindings(2);
+                    bindings[0] = frame_gpu;
+                    bindings[1] = preproc_out_gpu;
+
+                    std::vector<ncnn::vk_constant_type> constants(6);
+                    constants[0].i = frame_gpu.w;
+                    constants[1].i = frame_gpu.h;
+                    constants[2].i = frame_gpu.cstep;
+                    constants[3].i = preproc_out_gpu.w;
+                    constants[4].i = preproc_out_gpu.h;
+                    constants[5].i = preproc_out_gpu.cstep;
+
+                    cmd.record_pipeline(preproc, bindings, constants, preproc_out_gpu);
+                };
+                dispatches.push_back(d);
+            }
+
+            if (wanted(kernels, "postproc"))
+            {
+                Dispatch d = { "postproc", 3, 1, (size_t)w * h * 3 * es + (size_t)w * h * 3 * 4, 0 };
+                d.record = [&]() {
+                    std::vector<ncnn::VkMat> bindings(2);
+                    bindings[0] = frame_padded_gpu;
+                    bindings[1] = frame_out_gpu;
+
+                    std::vector<ncnn::vk_constant_type> constants(6);
+                    constants[0].i = frame_padded_gpu.w;
+                    constants[1].i = frame_padded_gpu.h;
+                    constants[2].i = frame_padded_gpu.cstep;
+                    constants[3].i = frame_out_gpu.w;
+                    constants[4].i = frame_out_gpu.h;
+                    constants[5].i = frame_out_gpu.cstep;
+
+                    cmd.record_pipeline(postproc, bindings, constants, frame_out_gpu);
+                };
+                dispatches.push_back(d);
+            }
+
+            // the flow sum of 8 variants, averaged as seen by the identity variant
+            ncnn::VkMat flow_sum_gpu;
+            ncnn::VkMat flow_avg_gpu;
+            if (wanted(kernels, "flow_tta_avg"))
+            {
+                cmd.record_clone(synthetic_mat(w, h, 2, 1, 16.f), flow_sum_gpu, opt);
+                flow_avg_gpu.create(w, h, 2, es, 1, blob_vkallocator);
+
+                Dispatch d = { "flow_tta_avg", 2, 1, (size_t)w * h * 2 * 4 + (size_t)w * h * 2 * es, 0 };
+                d.record = [&]() {
+                    std::vector<ncnn::VkMat> bindings(2);
+                    bindings[0] = flow_sum_gpu;
+                    bindings[1] = flow_avg_gpu;
+
+                    std::vector<ncnn::vk_constant_type> constants(6);
+                    constants[0].i = flow_sum_gpu.w;
+                    constants[1].i = flow_sum_gpu.h;
+                    constants[2].i = flow_avg_gpu.cstep;
+                    constants[3].i = flow_sum_gpu.cstep;
+                    constants[4].i = 0;
+                    constants[5].i = 8;
+
+                    ncnn::VkMat dispatcher;
+                    dispatcher.w = flow_sum_gpu.w;
+                    dispatcher.h = flow_sum_gpu.h;
+                    dispatcher.c = 1;
+                    cmd.record_pipeline(flow_tta_avg, bindings, constants, dispatcher);
+                };
+                dispatches.push_back(d);
+            }
+
+            // feature maps of channels in every packing, warped by a flow of a few pixels
+            ncnn::VkMat flow_gpu;
+            ncnn::VkMat flow4_gpu;
+            ncnn::VkMat image_gpu[3];
+            std::vector<ncnn::VkMat> warp_tops[3];
+            std::vector<ncnn::VkMat> warp2_tops[3];
+            const int packs[3] = { 1, 4, 8 };
+            if (wanted(kernels, "warp") || wanted(kernels, "warp2"))
+            {
+                cmd.record_upload(synthetic_mat(w, h, 2, 1, 4.f), flow_gpu, opt);
+                cmd.record_upload(synthetic_mat(w, h, 1, 4, 4.f), flow4_gpu, opt);
+
+                for (int k = 0; k < 3; k++)
+                {
+                    cmd.record_upload(synthetic_mat(w, h, channels / packs[k], packs[k], 1.f), image_gpu[k], opt);
+                    warp_tops[k].resize(1);
+                    warp2_tops[k].resize(2);
+                }
+            }
+
+            // the four source pixels of a bilinear sample mostly hit the cache, so each element is counted once
+            const size_t image_bytes = (size_t)w * h * channels * es;
+            for (int k = 0; k < 3 && wanted(kernels, "warp"); k++)
+            {
+                Dispatch d = { "warp", channels, packs[k], image_bytes * 2 + (size_t)w * h * 2 * es, 0 };
+                d.record = [&, k]() {
+                    std::vector<ncnn::VkMat> bottoms(2);
+                    bottoms[0] = image_gpu[k];
+                    bottoms[1] = flow_gpu;
+
+                    warp.forward(bottoms, warp_tops[k], cmd, opt);
+                };
+                dispatches.push_back(d);
+            }
+
+            for (int k = 0; k < 3 && wanted(kernels, "warp2"); k++)
+            {
+                Dispatch d = { "warp2", channels, packs[k], image_bytes * 4 + (size_t)w * h * 4 * es, 0 };
+                d.record = [&, k]() {
+                    std::vector<ncnn::VkMat> bottoms(3);
+                    bottoms[0] = image_gpu[k];
+                    bottoms[1] = image_gpu[k];
+                    bottoms[2] = flow4_gpu;
+
+                    warp2.forward(bottoms, warp2_tops[k], cmd, opt);
+                };
+                dispatches.push_back(d);
+            }
+
+            cmd.submit_and_wait();
+            cmd.reset();
+
+            for (size_t di = 0; di < dispatches.size(); di++)
+            {
+                const Dispatch& d = dispatches[di];
+
+                const double ms = measure(cmd, d.record, runs, repeats);
+                const double mb = d.bytes / 1048576.0;
+                const double gbps = mb / 1024.0 / ms * 1000.0;
+
+                printf("%s\n  {\"device\": %s, \"kernel\": \"%s\", \"width\": %d, \"height\": %d, \"channels\": %d, \"elempack\": %d, "
+                       "\"precision\": %d, \"mb\": %.1f, \"ms\": %.4f, \"gbps\": %.2f, \"copy_ratio\": %.3f}",
+                       first_result ? "" : ",", device.c_str(), d.kernel, w, h, d.channels, d.elempack, precision, mb, ms, gbps,
+                       copy_gbps > 0.0 ? gbps / copy_gbps : 0.0);
+                fflush(stdout);
+
+                first_result = false;
+            }
+        }
+
+        warp.destroy_pipeline(opt);
+        warp2.destroy_pipeline(opt);
+
+        delete preproc;
+        delete postproc;
+        delete flow_tta_avg;
+    }
+
+    printf("\n]\n");
+
+    vkdev->reclaim_blob_allocator(blob_vkallocator);
+    vkdev->reclaim_staging_allocator(staging_vkallocator);
+
+    ncnn::destroy_gpu_instance();
+
+    return ret;
+}
@@ -0,0 +1,254 @@
+// rife implemented with ncnn library
+
+// interpolates a synthetic frame pair on the cpu and compares the result with a stored reference, and the time taken
+// too when asked to, run by meson test, see tests/reference
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// ncnn
+#include "benchmark.h"
+#include "cpu.h"
+
+#include "model_pack.h"
+#include "rife.h"
+#include "tool_util.h"
+
+// exit code meson treats as a skipped test
+#define TEST_SKIP 77
+
+static bool file_exists(const std::string& path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    fclose(fp);
+    return true;
+}
+
+static double psnr(const Frame& a, const Frame& b)
+{
+    double sse = 0.0;
+    for (size_t i = 0; i < a.data.size(); i++)
+    {
+        const double diff = std::min(std::max(a.data[i], 0.f), 1.f) - std::min(std::max(b.data[i], 0.f), 1.f);
+        sse += diff * diff;
+    }
+
+    const double mse = sse / a.data.size();
+    return mse > 0.0 ? std::min(10.0 * log10(1.0 / mse), 100.0) : 100.0;
+}
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-test [options] --model <modeldir> --reference <prefix>\n");
+    fprintf(stderr, "  --reference <prefix>   reference output <prefix>.ppm and time <prefix>.time\n");
+    fprintf(stderr, "  --tta <n>              tta variants, defaults to 0\n");
+    fprintf(stderr, "  --uhd                  uhd mode\n");
+    fprintf(stderr, "  --size <WxH>           size of the synthetic frames, defaults to 200x120\n");
+    fprintf(stderr, "  --runs <n>             timed runs, the median is compared, defaults to 3\n");
+    fprintf(stderr, "  --min-psnr <db>        lowest PSNR against the reference output, defaults to 40\n");
+    fprintf(stderr, "  --max-slowdown <x>     fail above this ratio of the time to the reference time, off by default\n");
+    fprintf(stderr, "  --generate             write the reference output and time instead of comparing\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string modeldir;
+    std::string reference;
+    int tta = 0;
+    bool uhd = false;
+    int w = 200;
+    int h = 120;
+    int runs = 3;
+    double min_psnr = 40.0;
+    // times are only comparable on the machine that recorded the reference
+    double max_slowdown = 0.0;
+    bool generate = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--model") == 0 && has_value)
+            modeldir = argv[++i];
+        else if (strcmp(argv[i], "--reference") == 0 && has_value)
+            reference = argv[++i];
+        else if (strcmp(argv[i], "--tta") == 0 && has_value)
+            tta = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--uhd") == 0)
+            uhd = true;
+        else if (strcmp(argv[i], "--size") == 0 && has_value)
+        {
+            if (sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w < 1 || h < 1)
+            {
+                print_usage();
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--runs") == 0 && has_value)
+            runs = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--min-psnr") == 0 && has_value)
+            min_psnr = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-slowdown") == 0 && has_value)
+            max_slowdown = atof(argv[++i]);
+        else if (strcmp(argv[i], "--generate") == 0)
+            generate = true;
+        else
+        {
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (modeldir.empty() || reference.empty())
+    {
+        print_usage();
+        return -1;
+    }
+
+    bool rife_v2;
+    bool rife_v4;
+    int padding;
+    if (model_type(modeldir, rife_v2, rife_v4, padding) != 0)
+    {
+        fprintf(stderr, "unknown model dir type %s\n", modeldir.c_str());
+        return -1;
+    }
+
+    // the weights are not part of every checkout
+    if (!file_exists(modeldir + "/" MODEL_PACK_NAME) && !file_exists(modeldir + "/flownet.bin"))
+    {
+        fprintf(stderr, "%s has no weights, skipping\n", modeldir.c_str());
+        return TEST_SKIP;
+    }
+
+    const std::string reference_ppm = reference + ".ppm";
+    const std::string reference_time = reference + ".time";
+
+    Frame reference_out;
+    if (!generate)
+    {
+        if (!file_exists(reference_ppm))
+        {
+            fprintf(stderr, "%s not found, skipping, run with --generate to create it\n", reference_ppm.c_str());
+            return TEST_SKIP;
+        }
+
+        if (load_ppm(reference_ppm.c_str(), reference_out) != 0)
+            return -1;
+
+        if (reference_out.w != w || reference_out.h != h)
+        {
+            fprintf(stderr, "%s is %dx%d, expected %dx%d\n", reference_ppm.c_str(), reference_out.w, reference_out.h, w, h);
+            return -1;
+        }
+    }
+
+    // as in the plugin, uhd is the same as halving the flow resolution
+    const float scale = uhd ? 0.5f : 1.f;
+    if (scale < 1.f)
+        padding = (int)(padding / scale);
+
+    RIFE rife(-1, tta, false, ncnn::get_big_cpu_count(), rife_v2, rife_v4, padding, scale);
+    rife.set_precision(RIFE_PRECISION_FP32, RIFE_PRECISION_FP32, RIFE_PRECISION_FP32);
+
+#if _WIN32
+    if (rife.load(std::wstring(modeldir.begin(), modeldir.end())) != 0)
+#else
+    if (rife.load(modeldir) != 0)
+#endif
+    {
+        fprintf(stderr, "failed to load %s\n", modeldir.c_str());
+        return -1;
+    }
+
+    Frame frame0;
+    Frame frame1;
+    synthetic_pair(w, h, frame0, frame1);
+
+    Frame out;
+    out.w = w;
+    out.h = h;
+    out.data.resize((size_t)w * h * 3);
+
+    const size_t plane = (size_t)w * h;
+    const float* src0 = frame0.data.data();
+    const float* src1 = frame1.data.data();
+    float* dst = out.data.data();
+
+    // the first run pays for allocations and is not timed
+    std::vector<double> times;
+    for (int i = 0; i <= runs; i++)
+    {
+        const double start = ncnn::get_current_time();
+        rife.process(src0, src0 + plane, src0 + plane * 2, src1, src1 + plane, src1 + plane * 2,
+                     dst, dst + plane, dst + plane * 2, w, h, w, 0.5f);
+        if (i > 0)
+            times.push_back(ncnn::get_current_time() - start);
+    }
+
+    std::sort(times.begin(), times.end());
+    const double time_ms = times[times.size() / 2];
+
+    if (generate)
+    {
+        if (save_ppm(reference_ppm.c_str(), out) != 0)
+            return -1;
+
+        FILE* fp = fopen(reference_time.c_str(), "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", reference_time.c_str());
+            return -1;
+        }
+
+        fprintf(fp, "%.3f\n", time_ms);
+        fclose(fp);
+
+        fprintf(stderr, "wrote %s and %s, %.3f ms\n", reference_ppm.c_str(), reference_time.c_str(), time_ms);
+        return 0;
+    }
+
+    int ret = 0;
+
+    const double out_psnr = psnr(out, reference_out);
+    fprintf(stdout, "psnr %.2f dB, minimum %.2f dB\n", out_psnr, min_psnr);
+    if (out_psnr < min_psnr)
+    {
+        fprintf(stderr, "output differs from %s\n", reference_ppm.c_str());
+        ret = 1;
+    }
+
+    // the time is only compared when a reference time was recorded
+    double baseline_ms = 0.0;
+    FILE* fp = fopen(reference_time.c_str(), "rb");
+    if (fp)
+    {
+        if (fscanf(fp, "%lf", &baseline_ms) != 1)
+            baseline_ms = 0.0;
+        fclose(fp);
+    }
+
+    if (baseline_ms > 0.0)
+    {
+        fprintf(stdout, "time %.3f ms, reference %.3f ms, %.2fx\n", time_ms, baseline_ms, time_ms / baseline_ms);
+        if (max_slowdown > 0.0 && time_ms > baseline_ms * max_slowdown)
+        {
+            fprintf(stderr, "more than %.2fx slower than the reference time\n", max_slowdown);
+            ret = 1;
+        }
+    }
+    else
+    {
+        fprintf(stdout, "time %.3f ms, no reference time\n", time_ms);
+    }
+
+    return ret;
+}
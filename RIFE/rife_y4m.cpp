@@ -0,0 +1,857 @@
+// rife implemented with ncnn library
+
+// interpolates a yuv4mpeg2 stream without vapoursynth, reading, conversion to rgb, the interpolation, conversion back
+// and writing run on their own threads connected by bounded queues, so that the slowest of them sets the pace
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// ncnn
+#include "benchmark.h"
+#include "cpu.h"
+#include "gpu.h"
+
+#include "rife.h"
+#include "tool_util.h"
+
+// at most capacity items, push waits while it is full and pop while it is empty, until the queue is closed
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t _capacity) : capacity(_capacity), closed(false)
+    {
+    }
+
+    // false when the queue was closed, the consumer is gone
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [&]() { return items.size() < capacity || closed; });
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // false when the queue is closed and empty
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [&]() { return !items.empty() || closed; });
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+// the layout of the frames of a stream
+struct Y4MFormat
+{
+    int w;
+    int h;
+    int fps_num;
+    int fps_den;
+    // chroma subsampling as a shift, 4:2:0 is 1 and 1
+    int ssw;
+    int ssh;
+    int bits;
+    bool full_range;
+    // the header tokens after YUV4MPEG2, written back with the frame rate replaced
+    std::vector<std::string> tokens;
+
+    int bytes_per_sample() const
+    {
+        return bits > 8 ? 2 : 1;
+    }
+
+    size_t luma_size() const
+    {
+        return (size_t)w * h * bytes_per_sample();
+    }
+
+    size_t chroma_size() const
+    {
+        return (size_t)((w + (1 << ssw) - 1) >> ssw) * ((h + (1 << ssh) - 1) >> ssh) * bytes_per_sample();
+    }
+
+    size_t frame_size() const
+    {
+        return luma_size() + chroma_size() * 2;
+    }
+};
+
+// a line up to and without the newline, false at the end of the file
+static bool read_line(FILE* fp, std::string& line)
+{
+    line.clear();
+
+    int ch = fgetc(fp);
+    if (ch == EOF)
+        return false;
+
+    while (ch != '\n' && ch != EOF)
+    {
+        line += (char)ch;
+        ch = fgetc(fp);
+    }
+
+    return true;
+}
+
+static int parse_header(const std::string& line, Y4MFormat& format)
+{
+    if (line.compare(0, 9, "YUV4MPEG2") != 0)
+    {
+        fprintf(stderr, "not a yuv4mpeg2 stream\n");
+        return -1;
+    }
+
+    format.w = 0;
+    format.h = 0;
+    format.fps_num = 0;
+    format.fps_den = 0;
+    format.ssw = 1;
+    format.ssh = 1;
+    format.bits = 8;
+    format.full_range = false;
+
+    std::string colorspace = "420jpeg";
+
+    size_t pos = 9;
+    while (pos < line.size())
+    {
+        while (pos < line.size() && line[pos] == ' ')
+            pos++;
+
+        size_t end = line.find(' ', pos);
+        if (end == std::string::npos)
+            end = line.size();
+
+        if (end > pos)
+        {
+            const std::string token = line.substr(pos, end - pos);
+            if (token[0] == 'W')
+                format.w = atoi(token.c_str() + 1);
+            else if (token[0] == 'H')
+                format.h = atoi(token.c_str() + 1);
+            else if (token[0] == 'F')
+                sscanf(token.c_str() + 1, "%d:%d", &format.fps_num, &format.fps_den);
+            else if (token[0] == 'C')
+                colorspace = token.substr(1);
+            else if (token == "XCOLORRANGE=FULL")
+                format.full_range = true;
+            else if (token[0] == 'I' && token != "Ip" && token != "I?")
+            {
+                fprintf(stderr, "interlaced streams are not supported\n");
+                return -1;
+            }
+
+            format.tokens.push_back(token);
+        }
+
+        pos = end;
+    }
+
+    // 420, 420jpeg, 420paldv, 420mpeg2, 420p10, 422p16 ...
+    if (colorspace.compare(0, 3, "420") == 0)
+    {
+        format.ssw = 1;
+        format.ssh = 1;
+    }
+    else if (colorspace.compare(0, 3, "422") == 0)
+    {
+        format.ssw = 1;
+        format.ssh = 0;
+    }
+    else if (colorspace.compare(0, 3, "444") == 0 && colorspace.compare(0, 9, "444alpha") != 0)
+    {
+        format.ssw = 0;
+        format.ssh = 0;
+    }
+    else
+    {
+        fprintf(stderr, "colorspace C%s is not supported\n", colorspace.c_str());
+        return -1;
+    }
+
+    const size_t p = colorspace.find('p', 3);
+    if (p != std::string::npos && p + 1 < colorspace.size() && colorspace[p + 1] >= '0' && colorspace[p + 1] <= '9')
+        format.bits = atoi(colorspace.c_str() + p + 1);
+
+    if (format.w < 1 || format.h < 1 || format.fps_num < 1 || format.fps_den < 1 || format.bits < 8 || format.bits > 16)
+    {
+        fprintf(stderr, "invalid yuv4mpeg2 header %s\n", line.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+// the coefficients and ranges of a conversion between yuv and rgb in 0..1
+struct ColorMatrix
+{
+    float kr;
+    float kb;
+    float y_offset;
+    float y_scale;
+    float c_offset;
+    float c_scale;
+    float max_value;
+};
+
+static ColorMatrix color_matrix(const Y4MFormat& format, int matrix)
+{
+    ColorMatrix m;
+    m.kr = matrix == 601 ? 0.299f : matrix == 2020 ? 0.2627f : 0.2126f;
+    m.kb = matrix == 601 ? 0.114f : matrix == 2020 ? 0.0593f : 0.0722f;
+
+    const float s = (float)(1 << (format.bits - 8));
+    m.max_value = (float)((1 << format.bits) - 1);
+    m.c_offset = 128.f * s;
+    if (format.full_range)
+    {
+        m.y_offset = 0.f;
+        m.y_scale = m.max_value;
+        m.c_scale = m.max_value;
+    }
+    else
+    {
+        m.y_offset = 16.f * s;
+        m.y_scale = 219.f * s;
+        m.c_scale = 224.f * s;
+    }
+
+    return m;
+}
+
+static inline float load_sample(const unsigned char* plane, size_t i, int bytes)
+{
+    return bytes == 1 ? plane[i] : (float)(plane[i * 2] | (plane[i * 2 + 1] << 8));
+}
+
+static inline void store_sample(unsigned char* plane, size_t i, int bytes, float v, float max_value)
+{
+    const int q = (int)(std::min(std::max(v, 0.f), max_value) + 0.5f);
+    if (bytes == 1)
+    {
+        plane[i] = (unsigned char)q;
+    }
+    else
+    {
+        plane[i * 2] = (unsigned char)(q & 0xff);
+        plane[i * 2 + 1] = (unsigned char)(q >> 8);
+    }
+}
+
+// chroma is repeated over the pixels it covers, so that averaging it again in rgb_to_yuv gives back the source for unchanged pixels
+static void yuv_to_rgb(const Y4MFormat& format, const ColorMatrix& m, const unsigned char* yuv, Frame& rgb)
+{
+    const int w = format.w;
+    const int h = format.h;
+    const int cw = (w + (1 << format.ssw) - 1) >> format.ssw;
+    const int bytes = format.bytes_per_sample();
+
+    const unsigned char* yp = yuv;
+    const unsigned char* up = yuv + format.luma_size();
+    const unsigned char* vp = up + format.chroma_size();
+
+    rgb.w = w;
+    rgb.h = h;
+    rgb.data.resize((size_t)w * h * 3);
+    float* r = rgb.data.data();
+    float* g = r + (size_t)w * h;
+    float* b = g + (size_t)w * h;
+
+    const float kg = 1.f - m.kr - m.kb;
+
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            const size_t i = (size_t)y * w + x;
+            const size_t ci = (size_t)(y >> format.ssh) * cw + (x >> format.ssw);
+
+            const float luma = (load_sample(yp, i, bytes) - m.y_offset) / m.y_scale;
+            const float cb = (load_sample(up, ci, bytes) - m.c_offset) / m.c_scale;
+            const float cr = (load_sample(vp, ci, bytes) - m.c_offset) / m.c_scale;
+
+            r[i] = luma + 2.f * (1.f - m.kr) * cr;
+            b[i] = luma + 2.f * (1.f - m.kb) * cb;
+            g[i] = (luma - m.kr * r[i] - m.kb * b[i]) / kg;
+        }
+    }
+}
+
+static void rgb_to_yuv(const Y4MFormat& format, const ColorMatrix& m, const Frame& rgb, unsigned char* yuv)
+{
+    const int w = format.w;
+    const int h = format.h;
+    const int cw = (w + (1 << format.ssw) - 1) >> format.ssw;
+    const int ch = (h + (1 << format.ssh) - 1) >> format.ssh;
+    const int bytes = format.bytes_per_sample();
+
+    unsigned char* yp = yuv;
+    unsigned char* up = yuv + format.luma_size();
+    unsigned char* vp = up + format.chroma_size();
+
+    const float* r = rgb.data.data();
+    const float* g = r + (size_t)w * h;
+    const float* b = g + (size_t)w * h;
+
+    const float kg = 1.f - m.kr - m.kb;
+
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            const size_t i = (size_t)y * w + x;
+            const float luma = m.kr * r[i] + kg * g[i] + m.kb * b[i];
+            store_sample(yp, i, bytes, luma * m.y_scale + m.y_offset, m.max_value);
+        }
+    }
+
+    for (int cy = 0; cy < ch; cy++)
+    {
+        for (int cx = 0; cx < cw; cx++)
+        {
+            float cb = 0.f;
+            float cr = 0.f;
+            int count = 0;
+
+            for (int y = cy << format.ssh; y < std::min((cy + 1) << format.ssh, h); y++)
+            {
+                for (int x = cx << format.ssw; x < std::min((cx + 1) << format.ssw, w); x++)
+                {
+                    const size_t i = (size_t)y * w + x;
+                    const float luma = m.kr * r[i] + kg * g[i] + m.kb * b[i];
+                    cb += (b[i] - luma) / (2.f * (1.f - m.kb));
+                    cr += (r[i] - luma) / (2.f * (1.f - m.kr));
+                    count++;
+                }
+            }
+
+            const size_t ci = (size_t)cy * cw + cx;
+            store_sample(up, ci, bytes, cb / count * m.c_scale + m.c_offset, m.max_value);
+            store_sample(vp, ci, bytes, cr / count * m.c_scale + m.c_offset, m.max_value);
+        }
+    }
+}
+
+typedef std::shared_ptr<const std::vector<unsigned char> > RawPtr;
+
+// a source frame as read and converted to rgb
+struct SourceFrame
+{
+    RawPtr raw;
+    std::shared_ptr<const Frame> rgb;
+};
+
+// output frame seq, the interpolation between src0 and src1 at timestep, or src0 itself without src1
+struct Job
+{
+    int64_t seq;
+    std::shared_ptr<const SourceFrame> src0;
+    std::shared_ptr<const SourceFrame> src1;
+    float timestep;
+};
+
+// output frame seq, either the raw source frame or the rgb interpolation
+struct Result
+{
+    int64_t seq;
+    RawPtr raw;
+    std::shared_ptr<const Frame> rgb;
+};
+
+// time a stage spent working rather than waiting for its queues, in milliseconds
+struct StageTime
+{
+    const char* name;
+    std::atomic<int64_t> busy_us;
+};
+
+class Busy
+{
+public:
+    Busy(StageTime& _stage) : stage(_stage), start(ncnn::get_current_time())
+    {
+    }
+
+    ~Busy()
+    {
+        stage.busy_us += (int64_t)((ncnn::get_current_time() - start) * 1000.0);
+    }
+
+private:
+    StageTime& stage;
+    double start;
+};
+
+static void print_usage()
+{
+    fprintf(stderr, "Usage: rife-y4m [options] --model <modeldir> [input.y4m]\n");
+    fprintf(stderr, "  reads stdin without an input or with -, and writes the interpolated stream to stdout\n");
+    fprintf(stderr, "  --factor <n>           frame rate multiplier, only 2 for models before rife-v4, defaults to 2\n");
+    fprintf(stderr, "  --cpu                  run on the cpu instead of a vulkan device\n");
+    fprintf(stderr, "  --gpu <id>             vulkan device, defaults to the default device\n");
+    fprintf(stderr, "  --gpu-threads <n>      concurrent interpolations, the gpu_thread of the plugin, defaults to 2\n");
+    fprintf(stderr, "  --tta <n>              tta variants, defaults to 0\n");
+    fprintf(stderr, "  --uhd                  uhd mode, the same as a scale of 0.5\n");
+    fprintf(stderr, "  --scale <s>            flow scale, defaults to 1\n");
+    fprintf(stderr, "  --precision <p>        0 = fp32, 1 = fp16 storage, 2 = fp16 arithmetic, defaults to 1\n");
+    fprintf(stderr, "  --sc <threshold>       repeat the previous frame instead of interpolating across scene changes, gpu only\n");
+    fprintf(stderr, "  --matrix <m>           601, 709 or 2020, defaults to 709 above 1024x576 and 601 otherwise\n");
+    fprintf(stderr, "  --full-range           full range yuv, also set by XCOLORRANGE=FULL in the header\n");
+    fprintf(stderr, "  --queue <n>            frames each queue between the stages holds, defaults to 4\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string modeldir;
+    const char* input = 0;
+    int factor = 2;
+    bool cpu = false;
+    int gpuid = -2;
+    int gpu_threads = 2;
+    int tta = 0;
+    bool uhd = false;
+    float scale = 1.f;
+    int precision = RIFE_PRECISION_FP16_STORAGE;
+    float sc_threshold = 0.f;
+    int matrix = 0;
+    bool full_range = false;
+    int queue_size = 4;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--model") == 0 && has_value)
+            modeldir = argv[++i];
+        else if (strcmp(argv[i], "--factor") == 0 && has_value)
+            factor = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cpu") == 0)
+            cpu = true;
+        else if (strcmp(argv[i], "--gpu") == 0 && has_value)
+            gpuid = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--gpu-threads") == 0 && has_value)
+            gpu_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tta") == 0 && has_value)
+            tta = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--uhd") == 0)
+            uhd = true;
+        else if (strcmp(argv[i], "--scale") == 0 && has_value)
+            scale = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--precision") == 0 && has_value)
+            precision = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sc") == 0 && has_value)
+            sc_threshold = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--matrix") == 0 && has_value)
+            matrix = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--full-range") == 0)
+            full_range = true;
+        else if (strcmp(argv[i], "--queue") == 0 && has_value)
+            queue_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-") == 0 || argv[i][0] != '-')
+            input = argv[i];
+        else
+        {
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (modeldir.empty() || factor < 1 || gpu_threads < 1 || queue_size < 1 || scale <= 0.f || (matrix != 0 && matrix != 601 && matrix != 709 && matrix != 2020))
+    {
+        print_usage();
+        return -1;
+    }
+
+    bool rife_v2;
+    bool rife_v4;
+    int padding;
+    if (model_type(modeldir, rife_v2, rife_v4, padding) != 0)
+    {
+        fprintf(stderr, "unknown model dir type %s\n", modeldir.c_str());
+        return -1;
+    }
+
+    if (!rife_v4 && factor != 2)
+    {
+        fprintf(stderr, "only rife-v4 models support a factor other than 2\n");
+        return -1;
+    }
+
+    if (rife_v4 && tta)
+    {
+        fprintf(stderr, "rife-v4 models do not support tta\n");
+        return -1;
+    }
+
+    FILE* in = stdin;
+    if (input && strcmp(input, "-") != 0)
+    {
+        in = fopen(input, "rb");
+        if (!in)
+        {
+            fprintf(stderr, "fopen %s failed\n", input);
+            return -1;
+        }
+    }
+
+#if _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    std::string line;
+    Y4MFormat format;
+    if (!read_line(in, line) || parse_header(line, format) != 0)
+    {
+        if (in != stdin)
+            fclose(in);
+        return -1;
+    }
+
+    format.full_range = format.full_range || full_range;
+    if (matrix == 0)
+        matrix = format.w > 1024 || format.h > 576 ? 709 : 601;
+    const ColorMatrix color = color_matrix(format, matrix);
+
+    // as in the plugin, uhd is the same as halving the flow resolution
+    if (uhd && scale == 1.f)
+        scale = 0.5f;
+    if (scale < 1.f)
+        padding = (int)(padding / scale);
+
+    int num_threads = 1;
+    if (cpu)
+    {
+        gpuid = -1;
+        num_threads = ncnn::get_big_cpu_count();
+    }
+    else
+    {
+        if (ncnn::create_gpu_instance() != 0 || ncnn::get_gpu_count() == 0)
+        {
+            fprintf(stderr, "no vulkan device, use --cpu\n");
+            return -1;
+        }
+
+        if (gpuid == -2)
+            gpuid = ncnn::get_default_gpu_index();
+
+        if (gpuid < 0 || gpuid >= ncnn::get_gpu_count())
+        {
+            fprintf(stderr, "invalid gpu %d\n", gpuid);
+            ncnn::destroy_gpu_instance();
+            return -1;
+        }
+    }
+
+    int ret = 0;
+    {
+        RIFE rife(gpuid, tta, false, num_threads, rife_v2, rife_v4, padding, scale);
+        rife.set_precision(precision, precision, precision);
+        if (sc_threshold > 0.f && !cpu)
+            rife.set_scene_change_threshold(sc_threshold);
+
+#if _WIN32
+        if (rife.load(std::wstring(modeldir.begin(), modeldir.end())) != 0)
+#else
+        if (rife.load(modeldir) != 0)
+#endif
+        {
+            fprintf(stderr, "failed to load %s\n", modeldir.c_str());
+            ret = -1;
+        }
+
+        if (ret == 0)
+        {
+            // the output header is the input one at the new frame rate
+            int64_t fps_num = (int64_t)format.fps_num * factor;
+            int64_t fps_den = format.fps_den;
+            for (int64_t a = fps_num, b = fps_den; b != 0;)
+            {
+                const int64_t t = a % b;
+                a = b;
+                b = t;
+                if (b == 0)
+                {
+                    fps_num /= a;
+                    fps_den /= a;
+                }
+            }
+
+            std::string header = "YUV4MPEG2";
+            for (size_t i = 0; i < format.tokens.size(); i++)
+            {
+                if (format.tokens[i][0] == 'F')
+                    header += " F" + std::to_string(fps_num) + ":" + std::to_string(fps_den);
+                else
+                    header += " " + format.tokens[i];
+            }
+            header += "\n";
+            fwrite(header.data(), 1, header.size(), stdout);
+
+            StageTime read_time = { "read", { 0 } };
+            StageTime to_rgb_time = { "to rgb", { 0 } };
+            StageTime interpolate_time = { "interpolate", { 0 } };
+            StageTime to_yuv_time = { "to yuv", { 0 } };
+            StageTime write_time = { "write", { 0 } };
+
+            BoundedQueue<RawPtr> raw_queue(queue_size);
+            BoundedQueue<Job> job_queue((size_t)queue_size * factor);
+            BoundedQueue<Result> result_queue((size_t)queue_size * factor);
+            BoundedQueue<RawPtr> write_queue(queue_size);
+
+            std::atomic<int64_t> frames_in(0);
+            std::atomic<int64_t> frames_out(0);
+            std::atomic<int64_t> scene_changes(0);
+            std::atomic<bool> failed(false);
+
+            const double start = ncnn::get_current_time();
+
+            // a stage that can no longer pass frames on closes its input too, so that the stages before it stop as well
+            std::thread reader([&]() {
+                const size_t frame_size = format.frame_size();
+                std::string frame_line;
+                while (read_line(in, frame_line))
+                {
+                    if (frame_line.compare(0, 5, "FRAME") != 0)
+                    {
+                        fprintf(stderr, "expected FRAME, got %s\n", frame_line.c_str());
+                        failed = true;
+                        break;
+                    }
+
+                    std::shared_ptr<std::vector<unsigned char> > raw;
+                    {
+                        Busy busy(read_time);
+                        raw = std::make_shared<std::vector<unsigned char> >(frame_size);
+                        if (fread(raw->data(), 1, frame_size, in) != frame_size)
+                        {
+                            fprintf(stderr, "truncated frame %lld\n", (long long)frames_in.load());
+                            break;
+                        }
+                    }
+
+                    frames_in++;
+                    if (!raw_queue.push(raw))
+                        break;
+                }
+
+                raw_queue.close();
+            });
+
+            // also turns consecutive frames into jobs, the last frame is repeated like in the plugin
+            std::thread to_rgb([&]() {
+                std::shared_ptr<const SourceFrame> prev;
+                int64_t seq = 0;
+                bool open = true;
+
+                RawPtr raw;
+                while (open && raw_queue.pop(raw))
+                {
+                    std::shared_ptr<SourceFrame> cur = std::make_shared<SourceFrame>();
+                    {
+                        Busy busy(to_rgb_time);
+                        std::shared_ptr<Frame> rgb = std::make_shared<Frame>();
+                        yuv_to_rgb(format, color, raw->data(), *rgb);
+                        cur->raw = raw;
+                        cur->rgb = rgb;
+                    }
+
+                    if (prev)
+                    {
+                        for (int i = 0; i < factor && open; i++)
+                        {
+                            Job job = { seq++, prev, i ? cur : std::shared_ptr<const SourceFrame>(), (float)i / factor };
+                            open = job_queue.push(job);
+                        }
+                    }
+
+                    prev = cur;
+                }
+
+                for (int i = 0; i < factor && open && prev; i++)
+                {
+                    Job job = { seq++, prev, std::shared_ptr<const SourceFrame>(), 0.f };
+                    open = job_queue.push(job);
+                }
+
+                raw_queue.close();
+                job_queue.close();
+            });
+
+            std::atomic<int> workers_left(gpu_threads);
+            std::vector<std::thread> workers;
+            for (int t = 0; t < gpu_threads; t++)
+            {
+                workers.emplace_back([&]() {
+                    Job job;
+                    while (job_queue.pop(job))
+                    {
+                        Result result = { job.seq, job.src0->raw, std::shared_ptr<const Frame>() };
+
+                        if (job.src1)
+                        {
+                            Busy busy(interpolate_time);
+
+                            const Frame& f0 = *job.src0->rgb;
+                            const Frame& f1 = *job.src1->rgb;
+                            const size_t plane = (size_t)f0.w * f0.h;
+
+                            std::shared_ptr<Frame> out = std::make_shared<Frame>();
+                            out->w = f0.w;
+                            out->h = f0.h;
+                            out->data.resize(plane * 3);
+
+                            const float* src0 = f0.data.data();
+                            const float* src1 = f1.data.data();
+                            float* dst = out->data.data();
+                            int r = rife.process(src0, src0 + plane, src0 + plane * 2, src1, src1 + plane, src1 + plane * 2,
+                                                 dst, dst + plane, dst + plane * 2, f0.w, f0.h, f0.w, job.timestep);
+
+                            if (r == RIFE_SCENE_CHANGE)
+                                scene_changes++;
+                            else
+                                result.rgb = out;
+                        }
+
+                        if (!result_queue.push(result))
+                        {
+                            job_queue.close();
+                            break;
+                        }
+                    }
+
+                    if (--workers_left == 0)
+                        result_queue.close();
+                });
+            }
+
+            // puts the results back in order, only interpolated frames need converting
+            std::thread to_yuv([&]() {
+                std::map<int64_t, Result> pending;
+                int64_t next = 0;
+                bool open = true;
+
+                Result result;
+                while (open && result_queue.pop(result))
+                {
+                    pending[result.seq] = result;
+
+                    for (std::map<int64_t, Result>::iterator it = pending.begin(); open && it != pending.end() && it->first == next; it = pending.begin())
+                    {
+                        RawPtr raw = it->second.raw;
+                        if (it->second.rgb)
+                        {
+                            Busy busy(to_yuv_time);
+                            std::shared_ptr<std::vector<unsigned char> > yuv = std::make_shared<std::vector<unsigned char> >(format.frame_size());
+                            rgb_to_yuv(format, color, *it->second.rgb, yuv->data());
+                            raw = yuv;
+                        }
+
+                        pending.erase(it);
+                        next++;
+
+                        open = write_queue.push(raw);
+                    }
+                }
+
+                result_queue.close();
+                write_queue.close();
+            });
+
+            std::thread writer([&]() {
+                RawPtr raw;
+                while (write_queue.pop(raw))
+                {
+                    Busy busy(write_time);
+                    if (fwrite("FRAME\n", 1, 6, stdout) != 6 || fwrite(raw->data(), 1, raw->size(), stdout) != raw->size())
+                    {
+                        fprintf(stderr, "write failed after %lld frames\n", (long long)frames_out.load());
+                        failed = true;
+                        break;
+                    }
+
+                    frames_out++;
+                }
+
+                fflush(stdout);
+                write_queue.close();
+            });
+
+            reader.join();
+            to_rgb.join();
+            for (size_t t = 0; t < workers.size(); t++)
+                workers[t].join();
+            to_yuv.join();
+            writer.join();
+
+            const double seconds = (ncnn::get_current_time() - start) / 1000.0;
+
+            // the busiest stage is the one to speed up, interpolate is summed over the gpu threads
+            fprintf(stderr, "%lld frames in, %lld frames out, %lld scene changes, %.2f s, %.2f fps\n", (long long)frames_in.load(),
+                    (long long)frames_out.load(), (long long)scene_changes.load(), seconds, seconds > 0.0 ? frames_out / seconds : 0.0);
+
+            const StageTime* stages[] = { &read_time, &to_rgb_time, &interpolate_time, &to_yuv_time, &write_time };
+            for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+            {
+                const double busy = stages[i]->busy_us / 1000000.0 / (stages[i] == &interpolate_time ? gpu_threads : 1);
+                fprintf(stderr, "  %-12s busy %.2f s, %.0f%%\n", stages[i]->name, busy, seconds > 0.0 ? busy / seconds * 100.0 : 0.0);
+            }
+
+            if (failed)
+                ret = -1;
+        }
+    }
+
+    if (in != stdin)
+        fclose(in);
+
+    if (!cpu)
+        ncnn::destroy_gpu_instance();
+
+    return ret;
+}
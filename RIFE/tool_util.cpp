@@ -0,0 +1,215 @@
+// rife implemented with ncnn library
+
+#include "tool_util.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+
+// a smooth gradient, a checkerboard and a diagonal ramp, so that the flow has texture to lock on to
+static float pattern(int c, int x, int y, int w, int h)
+{
+    if (c == 0)
+        return 0.5f + 0.5f * sinf(x * 0.05f) * cosf(y * 0.03f);
+    if (c == 1)
+        return ((x >> 5) + (y >> 5)) % 2 ? 0.8f : 0.2f;
+    return (float)(x + y) / (w + h);
+}
+
+void synthetic_pair(int w, int h, Frame& frame0, Frame& frame1)
+{
+    frame0.w = frame1.w = w;
+    frame0.h = frame1.h = h;
+    frame0.data.resize((size_t)w * h * 3);
+    frame1.data.resize((size_t)w * h * 3);
+
+    for (int c = 0; c < 3; c++)
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                const size_t i = ((size_t)c * h + y) * w + x;
+                frame0.data[i] = pattern(c, x, y, w, h);
+                frame1.data[i] = pattern(c, x - 6, y - 3, w, h);
+            }
+        }
+    }
+}
+
+static int read_ppm_value(FILE* fp)
+{
+    int ch = fgetc(fp);
+    while (ch == '#' || isspace(ch))
+    {
+        if (ch == '#')
+        {
+            while (ch != '\n' && ch != EOF)
+                ch = fgetc(fp);
+        }
+        ch = fgetc(fp);
+    }
+
+    int v = 0;
+    while (ch >= '0' && ch <= '9')
+    {
+        v = v * 10 + (ch - '0');
+        ch = fgetc(fp);
+    }
+
+    return v;
+}
+
+int load_ppm(const char* path, Frame& frame)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    const int magic0 = fgetc(fp);
+    const int magic1 = fgetc(fp);
+    const int w = read_ppm_value(fp);
+    const int h = read_ppm_value(fp);
+    const int maxval = read_ppm_value(fp);
+
+    if (magic0 != 'P' || magic1 != '6' || w <= 0 || h <= 0 || maxval <= 0 || maxval > 65535)
+    {
+        fprintf(stderr, "%s is not a binary PPM\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    const int bytes = maxval > 255 ? 2 : 1;
+    std::vector<unsigned char> pixels((size_t)w * h * 3 * bytes);
+    const size_t nread = fread(pixels.data(), 1, pixels.size(), fp);
+    fclose(fp);
+
+    if (nread != pixels.size())
+    {
+        fprintf(stderr, "%s is truncated\n", path);
+        return -1;
+    }
+
+    frame.w = w;
+    frame.h = h;
+    frame.data.resize((size_t)w * h * 3);
+
+    for (size_t i = 0; i < (size_t)w * h; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const unsigned char* p = &pixels[(i * 3 + c) * bytes];
+            const int v = bytes == 2 ? p[0] << 8 | p[1] : p[0];
+            frame.data[(size_t)c * w * h + i] = (float)v / maxval;
+        }
+    }
+
+    return 0;
+}
+
+int save_ppm(const char* path, const Frame& frame)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    fprintf(fp, "P6\n%d %d\n65535\n", frame.w, frame.h);
+
+    const size_t plane = (size_t)frame.w * frame.h;
+    std::vector<unsigned char> pixels(plane * 3 * 2);
+    for (size_t i = 0; i < plane; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const float v = std::min(std::max(frame.data[c * plane + i], 0.f), 1.f);
+            const int v16 = (int)(v * 65535.f + 0.5f);
+            pixels[(i * 3 + c) * 2] = (unsigned char)(v16 >> 8);
+            pixels[(i * 3 + c) * 2 + 1] = (unsigned char)(v16 & 255);
+        }
+    }
+
+    const size_t nwritten = fwrite(pixels.data(), 1, pixels.size(), fp);
+    fclose(fp);
+
+    if (nwritten != pixels.size())
+    {
+        fprintf(stderr, "write %s failed\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int model_type(const std::string& modeldir, bool& rife_v2, bool& rife_v4, int& padding)
+{
+    rife_v2 = false;
+    rife_v4 = false;
+    padding = 32;
+
+    if (modeldir.find("rife-v2") != std::string::npos)
+        rife_v2 = true;
+    else if (modeldir.find("rife-v3.9") != std::string::npos)
+        rife_v4 = true;
+    else if (modeldir.find("rife-v3") != std::string::npos)
+        rife_v2 = true;
+    else if (modeldir.find("rife-v4") != std::string::npos)
+        rife_v4 = true;
+    else if (modeldir.find("rife4") != std::string::npos)
+        rife_v4 = true;
+    else if (modeldir.find("rife") == std::string::npos)
+        return -1;
+
+    if (modeldir.find("rife-v4.25") != std::string::npos)
+        padding = 64;
+    if (modeldir.find("rife-v4.25-lite") != std::string::npos)
+        padding = 128;
+    if (modeldir.find("rife-v4.26") != std::string::npos)
+        padding = 64;
+
+    return 0;
+}
+
+std::vector<std::string> split_list(const char* s)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* p = s; ; p++)
+    {
+        if (*p == ',' || *p == '\0')
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+
+            if (*p == '\0')
+                break;
+        }
+        else
+        {
+            item += *p;
+        }
+    }
+
+    return items;
+}
+
+std::string json_string(const std::string& s)
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '"' || s[i] == '\\')
+            out += '\\';
+        out += s[i];
+    }
+    out += '"';
+
+    return out;
+}
@@ -0,0 +1,37 @@
+// rife implemented with ncnn library
+
+#ifndef TOOL_UTIL_H
+#define TOOL_UTIL_H
+
+#include <string>
+#include <vector>
+
+// helpers shared by rife-bench, rife-shader-bench and rife-test
+
+// planar RGB in 0..1 with a stride of w
+struct Frame
+{
+    int w;
+    int h;
+    std::vector<float> data;
+};
+
+// a textured frame and a copy of it moved by (6, 3), generated rather than stored so tests need no input files
+void synthetic_pair(int w, int h, Frame& frame0, Frame& frame1);
+
+// binary PPM, 8 or 16 bit
+int load_ppm(const char* path, Frame& frame);
+
+// 16 bit binary PPM, the values are clamped to 0..1
+int save_ppm(const char* path, const Frame& frame);
+
+// rife_v2, rife_v4 and the padding of a model dir, by the same rules as the plugin
+int model_type(const std::string& modeldir, bool& rife_v2, bool& rife_v4, int& padding);
+
+// the items of a comma separated list, empty items are dropped
+std::vector<std::string> split_list(const char* s);
+
+// s quoted as a JSON string
+std::string json_string(const std::string& s);
+
+#endif // TOOL_UTIL_H
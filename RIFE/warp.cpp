@@ -2,15 +2,32 @@
 
 #include "rife_ops.h"
 
+#include <math.h>
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif // __ARM_NEON
+
+#if __SSE2__
+#include <emmintrin.h>
+#if __AVX__
+#include <immintrin.h>
+#endif // __AVX__
+#endif // __SSE2__
+
 #include "warp.comp.hex.h"
 #include "warp_pack4.comp.hex.h"
 #include "warp_pack8.comp.hex.h"
+#include "warp2.comp.hex.h"
+#include "warp2_pack4.comp.hex.h"
+#include "warp2_pack8.comp.hex.h"
 
 using namespace ncnn;
 
 Warp::Warp()
 {
     support_vulkan = true;
+    support_packing = true;
 
     pipeline_warp = 0;
     pipeline_warp_pack4 = 0;
@@ -37,7 +54,7 @@ int Warp::create_pipeline(const Option& opt)
         }
 
         pipeline_warp = new Pipeline(vkdev);
-        pipeline_warp->set_optimal_local_size_xyz();
+        pipeline_warp->set_optimal_local_size_xyz(8, 8, 1);
         pipeline_warp->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
@@ -54,7 +71,7 @@ int Warp::create_pipeline(const Option& opt)
         }
 
         pipeline_warp_pack4 = new Pipeline(vkdev);
-        pipeline_warp_pack4->set_optimal_local_size_xyz();
+        pipeline_warp_pack4->set_optimal_local_size_xyz(8, 8, 1);
         pipeline_warp_pack4->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
@@ -72,7 +89,7 @@ int Warp::create_pipeline(const Option& opt)
         }
 
         pipeline_warp_pack8 = new Pipeline(vkdev);
-        pipeline_warp_pack8->set_optimal_local_size_xyz();
+        pipeline_warp_pack8->set_optimal_local_size_xyz(8, 8, 1);
         pipeline_warp_pack8->create(spirv.data(), spirv.size() * 4, specializations);
     }
 
@@ -93,73 +110,188 @@ int Warp::destroy_pipeline(const Option& opt)
     return 0;
 }
 
-int Warp::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+// the four source pixels and the weights of one output pixel, shared by all channels
+struct WarpSample
 {
-    const Mat& image_blob = bottom_blobs[0];
-    const Mat& flow_blob = bottom_blobs[1];
+    int offset[4];
+    float alpha;
+    float beta;
+};
 
-    int w = image_blob.w;
-    int h = image_blob.h;
-    int channels = image_blob.c;
+// the flow of pixel x is read from fxptr[x * flow_step] and fyptr[x * flow_step]
+static void warp_row_samples(const float* fxptr, const float* fyptr, int flow_step, int y, int w, int h, WarpSample* samples)
+{
+    for (int x = 0; x < w; x++)
+    {
+        float sample_x = x + fxptr[x * flow_step];
+        float sample_y = y + fyptr[x * flow_step];
 
-    Mat& top_blob = top_blobs[0];
-    top_blob.create(w, h, channels);
-    if (top_blob.empty())
-        return -100;
+        int x0 = (int)floorf(sample_x);
+        int y0 = (int)floorf(sample_y);
+
+        WarpSample& s = samples[x];
+
+        if (x0 >= 0 && y0 >= 0 && x0 < w - 1 && y0 < h - 1)
+        {
+            // interior, no clamping needed
+            s.offset[0] = y0 * w + x0;
+            s.offset[1] = s.offset[0] + 1;
+            s.offset[2] = s.offset[0] + w;
+            s.offset[3] = s.offset[2] + 1;
+        }
+        else
+        {
+            int x1 = x0 + 1;
+            int y1 = y0 + 1;
+
+            x0 = std::min(std::max(x0, 0), w - 1);
+            y0 = std::min(std::max(y0, 0), h - 1);
+            x1 = std::min(std::max(x1, 0), w - 1);
+            y1 = std::min(std::max(y1, 0), h - 1);
+
+            s.offset[0] = y0 * w + x0;
+            s.offset[1] = y0 * w + x1;
+            s.offset[2] = y1 * w + x0;
+            s.offset[3] = y1 * w + x1;
+        }
+
+        s.alpha = sample_x - x0;
+        s.beta = sample_y - y0;
+    }
+}
 
-    #pragma omp parallel for num_threads(opt.num_threads)
-    for (int q = 0; q < channels; q++)
+static void warp_row_pack1(const float* ptr, const WarpSample* samples, int w, float* outptr)
+{
+    for (int x = 0; x < w; x++)
     {
-        float* outptr = top_blob.channel(q);
+        const WarpSample& s = samples[x];
 
-        const Mat image = image_blob.channel(q);
+        float v0 = ptr[s.offset[0]];
+        float v1 = ptr[s.offset[1]];
+        float v2 = ptr[s.offset[2]];
+        float v3 = ptr[s.offset[3]];
 
-        const float* fxptr = flow_blob.channel(0);
-        const float* fyptr = flow_blob.channel(1);
+        float v4 = v0 * (1 - s.alpha) + v1 * s.alpha;
+        float v5 = v2 * (1 - s.alpha) + v3 * s.alpha;
 
-        for (int y = 0; y < h; y++)
-        {
-            for (int x = 0; x < w; x++)
-            {
-                float flow_x = fxptr[0];
-                float flow_y = fyptr[0];
+        outptr[x] = v4 * (1 - s.beta) + v5 * s.beta;
+    }
+}
+
+static inline void warp_pixel_pack4(const float* p0, const float* p1, const float* p2, const float* p3, float alpha, float beta, float* outptr)
+{
+#if __SSE2__
+    __m128 _alpha = _mm_set1_ps(alpha);
+    __m128 _alpha1 = _mm_set1_ps(1 - alpha);
+    __m128 _beta = _mm_set1_ps(beta);
+    __m128 _beta1 = _mm_set1_ps(1 - beta);
+
+    __m128 _v4 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p0), _alpha1), _mm_mul_ps(_mm_loadu_ps(p1), _alpha));
+    __m128 _v5 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p2), _alpha1), _mm_mul_ps(_mm_loadu_ps(p3), _alpha));
+
+    _mm_storeu_ps(outptr, _mm_add_ps(_mm_mul_ps(_v4, _beta1), _mm_mul_ps(_v5, _beta)));
+#elif __ARM_NEON
+    float32x4_t _alpha = vdupq_n_f32(alpha);
+    float32x4_t _alpha1 = vdupq_n_f32(1 - alpha);
+    float32x4_t _beta = vdupq_n_f32(beta);
+    float32x4_t _beta1 = vdupq_n_f32(1 - beta);
+
+    float32x4_t _v4 = vaddq_f32(vmulq_f32(vld1q_f32(p0), _alpha1), vmulq_f32(vld1q_f32(p1), _alpha));
+    float32x4_t _v5 = vaddq_f32(vmulq_f32(vld1q_f32(p2), _alpha1), vmulq_f32(vld1q_f32(p3), _alpha));
+
+    vst1q_f32(outptr, vaddq_f32(vmulq_f32(_v4, _beta1), vmulq_f32(_v5, _beta)));
+#else
+    for (int k = 0; k < 4; k++)
+    {
+        float v4 = p0[k] * (1 - alpha) + p1[k] * alpha;
+        float v5 = p2[k] * (1 - alpha) + p3[k] * alpha;
+
+        outptr[k] = v4 * (1 - beta) + v5 * beta;
+    }
+#endif
+}
+
+static void warp_row_pack4(const float* ptr, const WarpSample* samples, int w, float* outptr)
+{
+    for (int x = 0; x < w; x++)
+    {
+        const WarpSample& s = samples[x];
+
+        warp_pixel_pack4(ptr + s.offset[0] * 4, ptr + s.offset[1] * 4, ptr + s.offset[2] * 4, ptr + s.offset[3] * 4, s.alpha, s.beta, outptr);
+
+        outptr += 4;
+    }
+}
+
+static void warp_row_pack8(const float* ptr, const WarpSample* samples, int w, float* outptr)
+{
+    for (int x = 0; x < w; x++)
+    {
+        const WarpSample& s = samples[x];
+
+        const float* p0 = ptr + s.offset[0] * 8;
+        const float* p1 = ptr + s.offset[1] * 8;
+        const float* p2 = ptr + s.offset[2] * 8;
+        const float* p3 = ptr + s.offset[3] * 8;
 
-                float sample_x = x + flow_x;
-                float sample_y = y + flow_y;
+#if __AVX__
+        __m256 _alpha = _mm256_set1_ps(s.alpha);
+        __m256 _alpha1 = _mm256_set1_ps(1 - s.alpha);
+        __m256 _beta = _mm256_set1_ps(s.beta);
+        __m256 _beta1 = _mm256_set1_ps(1 - s.beta);
 
-                // bilinear interpolate
-                float v;
-                {
-                    int x0 = floor(sample_x);
-                    int y0 = floor(sample_y);
-                    int x1 = x0 + 1;
-                    int y1 = y0 + 1;
+        __m256 _v4 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p0), _alpha1), _mm256_mul_ps(_mm256_loadu_ps(p1), _alpha));
+        __m256 _v5 = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p2), _alpha1), _mm256_mul_ps(_mm256_loadu_ps(p3), _alpha));
 
-                    x0 = std::min(std::max(x0, 0), w - 1);
-                    y0 = std::min(std::max(y0, 0), h - 1);
-                    x1 = std::min(std::max(x1, 0), w - 1);
-                    y1 = std::min(std::max(y1, 0), h - 1);
+        _mm256_storeu_ps(outptr, _mm256_add_ps(_mm256_mul_ps(_v4, _beta1), _mm256_mul_ps(_v5, _beta)));
+#else
+        warp_pixel_pack4(p0, p1, p2, p3, s.alpha, s.beta, outptr);
+        warp_pixel_pack4(p0 + 4, p1 + 4, p2 + 4, p3 + 4, s.alpha, s.beta, outptr + 4);
+#endif
 
-                    float alpha = sample_x - x0;
-                    float beta = sample_y - y0;
+        outptr += 8;
+    }
+}
 
-                    float v0 = image.row(y0)[x0];
-                    float v1 = image.row(y0)[x1];
-                    float v2 = image.row(y1)[x0];
-                    float v3 = image.row(y1)[x1];
+static void warp_row(const float* ptr, const WarpSample* samples, int w, int elempack, float* outptr)
+{
+    if (elempack == 8)
+        warp_row_pack8(ptr, samples, w, outptr);
+    else if (elempack == 4)
+        warp_row_pack4(ptr, samples, w, outptr);
+    else // if (elempack == 1)
+        warp_row_pack1(ptr, samples, w, outptr);
+}
+
+int Warp::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& image_blob = bottom_blobs[0];
+    const Mat& flow_blob = bottom_blobs[1];
 
-                    float v4 = v0 * (1 - alpha) + v1 * alpha;
-                    float v5 = v2 * (1 - alpha) + v3 * alpha;
+    int w = image_blob.w;
+    int h = image_blob.h;
+    int channels = image_blob.c;
+    size_t elemsize = image_blob.elemsize;
+    int elempack = image_blob.elempack;
 
-                    v = v4 * (1 - beta) + v5 * beta;
-                }
+    Mat& top_blob = top_blobs[0];
+    top_blob.create(w, h, channels, elemsize, elempack, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
 
-                outptr[0] = v;
+    // rows rather than channels are spread over the threads, the flow of a row is read once for all channels
+    #pragma omp parallel num_threads(opt.num_threads)
+    {
+        std::vector<WarpSample> samples(w);
 
-                outptr += 1;
+        #pragma omp for
+        for (int y = 0; y < h; y++)
+        {
+            warp_row_samples(flow_blob.channel(0).row(y), flow_blob.channel(1).row(y), 1, y, w, h, samples.data());
 
-                fxptr += 1;
-                fyptr += 1;
+            for (int q = 0; q < channels; q++)
+            {
+                warp_row(image_blob.channel(q), samples.data(), w, elempack, top_blob.channel(q).row(y));
             }
         }
     }
@@ -188,23 +320,238 @@ int Warp::forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& to
     bindings[1] = flow_blob;
     bindings[2] = top_blob;
 
-    std::vector<vk_constant_type> constants(4);
+    std::vector<vk_constant_type> constants(5);
     constants[0].i = top_blob.w;
     constants[1].i = top_blob.h;
     constants[2].i = top_blob.c;
     constants[3].i = top_blob.cstep;
+    constants[4].i = flow_blob.cstep;
+
+    // one invocation per pixel, looping over the channels
+    VkMat dispatcher;
+    dispatcher.w = top_blob.w;
+    dispatcher.h = top_blob.h;
+    dispatcher.c = 1;
+
+    if (elempack == 8)
+    {
+        cmd.record_pipeline(pipeline_warp_pack8, bindings, constants, dispatcher);
+    }
+    else if (elempack == 4)
+    {
+        cmd.record_pipeline(pipeline_warp_pack4, bindings, constants, dispatcher);
+    }
+    else // if (elempack == 1)
+    {
+        cmd.record_pipeline(pipeline_warp, bindings, constants, dispatcher);
+    }
+
+    return 0;
+}
+
+Warp2::Warp2()
+{
+    support_vulkan = true;
+    support_packing = true;
+
+    pipeline_warp2 = 0;
+    pipeline_warp2_pack4 = 0;
+    pipeline_warp2_pack8 = 0;
+}
+
+int Warp2::create_pipeline(const Option& opt)
+{
+    if (!vkdev)
+        return 0;
+
+    std::vector<vk_specialization_type> specializations(0 + 0);
+
+    // pack1
+    {
+        static std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
+        {
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
+            {
+                compile_spirv_module(warp2_comp_data, sizeof(warp2_comp_data), opt, spirv);
+            }
+        }
+
+        pipeline_warp2 = new Pipeline(vkdev);
+        pipeline_warp2->set_optimal_local_size_xyz(8, 8, 1);
+        pipeline_warp2->create(spirv.data(), spirv.size() * 4, specializations);
+    }
+
+    // pack4
+    {
+        static std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
+        {
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
+            {
+                compile_spirv_module(warp2_pack4_comp_data, sizeof(warp2_pack4_comp_data), opt, spirv);
+            }
+        }
+
+        pipeline_warp2_pack4 = new Pipeline(vkdev);
+        pipeline_warp2_pack4->set_optimal_local_size_xyz(8, 8, 1);
+        pipeline_warp2_pack4->create(spirv.data(), spirv.size() * 4, specializations);
+    }
+
+    // pack8
+    if (opt.use_shader_pack8)
+    {
+        static std::vector<uint32_t> spirv;
+        static ncnn::Mutex lock;
+        {
+            ncnn::MutexLockGuard guard(lock);
+            if (spirv.empty())
+            {
+                compile_spirv_module(warp2_pack8_comp_data, sizeof(warp2_pack8_comp_data), opt, spirv);
+            }
+        }
+
+        pipeline_warp2_pack8 = new Pipeline(vkdev);
+        pipeline_warp2_pack8->set_optimal_local_size_xyz(8, 8, 1);
+        pipeline_warp2_pack8->create(spirv.data(), spirv.size() * 4, specializations);
+    }
+
+    return 0;
+}
+
+int Warp2::destroy_pipeline(const Option& opt)
+{
+    delete pipeline_warp2;
+    pipeline_warp2 = 0;
+
+    delete pipeline_warp2_pack4;
+    pipeline_warp2_pack4 = 0;
+
+    delete pipeline_warp2_pack8;
+    pipeline_warp2_pack8 = 0;
+
+    return 0;
+}
+
+int Warp2::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& image0_blob = bottom_blobs[0];
+    const Mat& image1_blob = bottom_blobs[1];
+    const Mat& flow_blob = bottom_blobs[2];
+
+    int w = image0_blob.w;
+    int h = image0_blob.h;
+    int channels = image0_blob.c;
+    size_t elemsize = image0_blob.elemsize;
+    int elempack = image0_blob.elempack;
+
+    // the flow has 4 channels and may arrive packed
+    const int flow_elempack = flow_blob.elempack;
+
+    Mat& top0_blob = top_blobs[0];
+    top0_blob.create(w, h, channels, elemsize, elempack, opt.blob_allocator);
+    if (top0_blob.empty())
+        return -100;
+
+    Mat& top1_blob = top_blobs[1];
+    top1_blob.create(w, h, channels, elemsize, elempack, opt.blob_allocator);
+    if (top1_blob.empty())
+        return -100;
+
+    #pragma omp parallel num_threads(opt.num_threads)
+    {
+        std::vector<WarpSample> samples0(w);
+        std::vector<WarpSample> samples1(w);
+
+        #pragma omp for
+        for (int y = 0; y < h; y++)
+        {
+            const float* fptr[4];
+            for (int k = 0; k < 4; k++)
+            {
+                fptr[k] = flow_blob.channel(k / flow_elempack).row(y) + k % flow_elempack;
+            }
+
+            warp_row_samples(fptr[0], fptr[1], flow_elempack, y, w, h, samples0.data());
+            warp_row_samples(fptr[2], fptr[3], flow_elempack, y, w, h, samples1.data());
+
+            for (int q = 0; q < channels; q++)
+            {
+                warp_row(image0_blob.channel(q), samples0.data(), w, elempack, top0_blob.channel(q).row(y));
+                warp_row(image1_blob.channel(q), samples1.data(), w, elempack, top1_blob.channel(q).row(y));
+            }
+        }
+    }
+
+    return 0;
+}
+
+int Warp2::forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& top_blobs, VkCompute& cmd, const Option& opt) const
+{
+    const VkMat& image0_blob = bottom_blobs[0];
+    const VkMat& image1_blob = bottom_blobs[1];
+
+    int w = image0_blob.w;
+    int h = image0_blob.h;
+    int channels = image0_blob.c;
+    size_t elemsize = image0_blob.elemsize;
+    int elempack = image0_blob.elempack;
+
+    // the shaders read the flow as pack4 or pack1 as it is, a blob of 4 channels is never pack8
+    VkMat flow_blob = bottom_blobs[2];
+    if (flow_blob.elempack != 4 && flow_blob.elempack != 1)
+    {
+        vkdev->convert_packing(bottom_blobs[2], flow_blob, 4, cmd, opt);
+        if (flow_blob.empty())
+            return -100;
+    }
+
+    VkMat& top0_blob = top_blobs[0];
+    top0_blob.create(w, h, channels, elemsize, elempack, opt.blob_vkallocator);
+    if (top0_blob.empty())
+        return -100;
+
+    VkMat& top1_blob = top_blobs[1];
+    top1_blob.create(w, h, channels, elemsize, elempack, opt.blob_vkallocator);
+    if (top1_blob.empty())
+        return -100;
+
+    // the flow is bound twice, as vec4 and as scalars, and flow_elempack picks the one to read
+    std::vector<VkMat> bindings(6);
+    bindings[0] = image0_blob;
+    bindings[1] = image1_blob;
+    bindings[2] = flow_blob;
+    bindings[3] = top0_blob;
+    bindings[4] = top1_blob;
+    bindings[5] = flow_blob;
+
+    std::vector<vk_constant_type> constants(6);
+    constants[0].i = top0_blob.w;
+    constants[1].i = top0_blob.h;
+    constants[2].i = top0_blob.c;
+    constants[3].i = top0_blob.cstep;
+    constants[4].i = flow_blob.elempack;
+    constants[5].i = flow_blob.cstep;
+
+    // one invocation per pixel, looping over the channels
+    VkMat dispatcher;
+    dispatcher.w = top0_blob.w;
+    dispatcher.h = top0_blob.h;
+    dispatcher.c = 1;
 
     if (elempack == 8)
     {
-        cmd.record_pipeline(pipeline_warp_pack8, bindings, constants, top_blob);
+        cmd.record_pipeline(pipeline_warp2_pack8, bindings, constants, dispatcher);
     }
     else if (elempack == 4)
     {
-        cmd.record_pipeline(pipeline_warp_pack4, bindings, constants, top_blob);
+        cmd.record_pipeline(pipeline_warp2_pack4, bindings, constants, dispatcher);
     }
     else // if (elempack == 1)
     {
-        cmd.record_pipeline(pipeline_warp, bindings, constants, top_blob);
+        cmd.record_pipeline(pipeline_warp2, bindings, constants, dispatcher);
     }
 
     return 0;